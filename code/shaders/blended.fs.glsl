@@ -13,5 +13,6 @@ layout(location = 0) out  vec4 color;
 void main()
 {
 	vec4 tex = vec4(texture(sampler0, vec2(texcoord.x, texcoord.y)));
-	color = vec4(tex.xy, tex.z / 1.2, 0.85);
+	// premultiplied output, drawn at a constant 0.85 opacity
+	color = vec4(tex.xy, tex.z / 1.2, 1.0) * 0.85;
 }
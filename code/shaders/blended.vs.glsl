@@ -1,8 +1,8 @@
 #version 330
 
 // Input attributes
-in vec3 in_position;
-in vec2 in_texcoord;
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec2 in_texcoord;
 
 // Passed to fragment shader
 out vec2 texcoord;
@@ -10,10 +10,11 @@ out vec2 texcoord;
 // Application data
 uniform mat3 transform;
 uniform mat3 projection;
+uniform vec4 uv_rect; // offset (xy) and scale (zw) of the sprite sheet frame, (0, 0, 1, 1) otherwise
 
 void main()
 {
-	texcoord = in_texcoord;
+	texcoord = uv_rect.xy + in_texcoord * uv_rect.zw;
 	vec3 pos = projection * transform * vec3(in_position.xy, 1.0);
 	gl_Position = vec4(pos.xy, in_position.z, 1.0);
 }
\ No newline at end of file
@@ -1,8 +1,8 @@
 #version 330
 
 // Input attributes
-in vec3 in_position;
-in vec3 in_color;
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_color;
 
 out vec3 vcolor;
 out vec2 vpos;
@@ -0,0 +1,38 @@
+#version 330
+#define MAX_LIGHTS 32
+#define ATTENUATION_LUT_RANGE 2048.0
+
+// From vertex shader
+in vec2 worldPos;
+
+// Application data
+uniform sampler2D attenuation_lut; // 300 / dist^drop-off, one row per light
+layout(std140) uniform LightBlock
+{
+	vec4 lights[MAX_LIGHTS]; // xy - position, z - drop-off exponent
+	int lightCount;
+};
+
+// r - summed light intensity, g - 1 within the bright radius of a light
+layout(location = 0) out vec2 light;
+
+void main()
+{
+	float intensity = 0.0;
+	float isLit = 0.0;
+	for (int i = 0; i < lightCount; i++)
+	{
+		vec3 l = lights[i].xyz;
+		float dist = distance(worldPos, l.xy);
+
+		// darker at larger distance, larger drop-off value simulates smaller light source
+		vec2 lut_coord = vec2(dist / ATTENUATION_LUT_RANGE, (float(i) + 0.5) / float(MAX_LIGHTS));
+		intensity += texture(attenuation_lut, lut_coord).r;
+
+		if (dist < l.z * 100.0)
+		{
+			isLit = 1.0;
+		}
+	}
+	light = vec2(intensity, isLit);
+}
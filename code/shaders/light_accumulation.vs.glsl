@@ -0,0 +1,15 @@
+#version 330
+
+layout(location = 0) in vec3 in_position;
+
+// Position in the coordinates the frame's sprites are placed in
+out vec2 worldPos;
+
+// Application data
+uniform mat3 inverse_projection;
+
+void main()
+{
+	gl_Position = vec4(in_position.xy, 0, 1.0);
+	worldPos = (inverse_projection * vec3(in_position.xy, 1.0)).xy;
+}
@@ -0,0 +1,57 @@
+#version 330
+#define MAX_LIGHTS 32
+#define MAX_PARALLAX_LAYERS 8
+
+// Which effect the background was requested with, keep in sync with SPRITE_FLAGS
+#define FLAG_LIT 1      // textured
+#define FLAG_BLENDED 4  // blended
+
+// From vertex shader
+in vec2 screenCoord;
+
+// Application data
+uniform sampler2DArray layers; // the backgrounds, back to front
+uniform vec4 layer_rects[MAX_PARALLAX_LAYERS]; // texture coordinates at the frame's bottom left (xy) and top right (zw)
+uniform int layer_flags[MAX_PARALLAX_LAYERS];
+uniform int layer_count;
+uniform sampler2D light_buffer; // r - light intensity, g - bright radius, from the light pass
+uniform vec4 light_rect; // texture coordinates the light buffer covers, like layer_rects
+layout(std140) uniform LightBlock
+{
+	vec4 lights[MAX_LIGHTS]; // xy - position, z - drop-off exponent
+	int lightCount;
+};
+
+// Output color
+layout(location = 0) out vec4 color;
+
+void main()
+{
+	color = vec4(0.0);
+	for (int i = 0; i < layer_count; i++)
+	{
+		vec2 texcoord = mix(layer_rects[i].xy, layer_rects[i].zw, screenCoord);
+		vec4 layer = texture(layers, vec3(texcoord, float(i)));
+		// Lit at the world position the layer shows here, which scrolls with its own camera
+		vec2 lightCoord = (texcoord - light_rect.xy) / (light_rect.zw - light_rect.xy);
+		vec2 light = lightCount > 0 ? texture(light_buffer, lightCoord).rg : vec2(0.0);
+		// the sprite's quad ends at the texture's edges
+		vec2 inside = step(vec2(0.0), texcoord) * step(texcoord, vec2(1.0));
+
+		// same as blended.fs.glsl and textured.fs.glsl
+		if ((layer_flags[i] & FLAG_BLENDED) != 0)
+		{
+			layer = vec4(layer.xy, layer.z / 1.2, 1.0) * 0.85;
+		}
+		else if (lightCount > 0)
+		{
+			vec3 baseColor = vec3(0.01, 0.01, 0.0) * layer.a + light.r * layer.xyz;
+			layer.xyz = min(baseColor, vec3(layer.a));
+			layer.z /= mix(1.0, 1.3, min(light.g, 1.0));
+		}
+
+		// premultiplied, each layer goes over the ones behind it
+		layer *= inside.x * inside.y;
+		color = layer + color * (1.0 - layer.a);
+	}
+}
@@ -0,0 +1,12 @@
+#version 330
+
+layout(location = 0) in vec3 in_position;
+
+// Position in the frame, (0, 0) bottom left to (1, 1) top right
+out vec2 screenCoord;
+
+void main()
+{
+	gl_Position = vec4(in_position.xy, 0, 1.0);
+	screenCoord = in_position.xy * 0.5 + 0.5;
+}
@@ -1,7 +1,7 @@
 #version 330
 
-in vec3 in_position;
-in vec3 in_color;
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_color;
 
 out vec3 vcolor;
 out vec2 vpos;
@@ -0,0 +1,56 @@
+#version 330
+#define MAX_LIGHTS 32
+
+// Which effect the sprite was requested with, keep in sync with SPRITE_FLAGS
+#define FLAG_LIT 1      // textured
+#define FLAG_FADE 2     // overlay_textured
+#define FLAG_BLENDED 4  // blended
+
+// From vertex shader
+in vec2 texcoord;
+in vec2 lightCoord;
+in vec3 spriteColor;
+in float fadingFactor;
+flat in int spriteFlags;
+
+// Application data
+uniform sampler2D sampler0;
+uniform sampler2D light_buffer; // r - light intensity, g - bright radius, from the light pass
+layout(std140) uniform LightBlock
+{
+	vec4 lights[MAX_LIGHTS]; // xy - position, z - drop-off exponent
+	int lightCount;
+};
+
+// Output color
+layout(location = 0) out  vec4 color;
+
+void main()
+{
+	vec4 tex = texture(sampler0, vec2(texcoord.x, texcoord.y));
+
+	if ((spriteFlags & FLAG_BLENDED) != 0)
+	{
+		color = vec4(tex.xy, tex.z / 1.2, 1.0) * 0.85;
+		return;
+	}
+
+	color = vec4(spriteColor, 1) * tex;
+
+	if ((spriteFlags & FLAG_FADE) != 0 && fadingFactor > 0)
+	{
+		color = color * fadingFactor;
+	}
+
+	if ((spriteFlags & FLAG_LIT) != 0 && lightCount > 0)
+	{
+		// Accumulated for all lights at a lower resolution by the light pass
+		vec2 light = texture(light_buffer, lightCoord).rg;
+		// premultiplied, so the ambient term and the clamp scale with alpha
+		vec3 baseColor = vec3(0.01, 0.01, 0.0) * color.a + light.r * color.xyz;
+		color.xyz = min(baseColor, vec3(color.a));
+
+		// slightly yellow tinge, filtered at the edge of the bright radius
+		color.z /= mix(1.0, 1.3, min(light.g, 1.0));
+	}
+}
@@ -0,0 +1,37 @@
+#version 330
+
+// Input attributes, per vertex of the unit sprite quad
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec2 in_texcoord;
+
+// Input attributes, per sprite instance
+layout(location = 2) in vec3 in_transform_0; // columns of the transform matrix
+layout(location = 3) in vec3 in_transform_1;
+layout(location = 4) in vec3 in_transform_2;
+layout(location = 5) in vec4 in_uv_rect;     // xy - offset, zw - size of the sprite's part of the texture
+layout(location = 6) in vec4 in_color_fade;  // rgb - colour, a - fading factor
+layout(location = 7) in float in_flags;
+
+// Passed to fragment shader
+out vec2 texcoord;
+out vec2 lightCoord; // world position in the light buffer
+out vec3 spriteColor;
+out float fadingFactor;
+flat out int spriteFlags;
+
+// Application data
+uniform mat3 projection;
+uniform mat3 light_projection; // projection of the light pass, the player camera's
+
+void main()
+{
+	mat3 transform = mat3(in_transform_0, in_transform_1, in_transform_2);
+	texcoord = in_uv_rect.xy + in_texcoord * in_uv_rect.zw;
+	spriteColor = in_color_fade.rgb;
+	fadingFactor = in_color_fade.a;
+	spriteFlags = int(in_flags);
+	vec3 world_pos = transform * vec3(in_position.xy, 1.0);
+	vec3 pos = projection * world_pos;
+	gl_Position = vec4(pos.xy, in_position.z, 1.0);
+	lightCoord = (light_projection * world_pos).xy * 0.5 + 0.5;
+}
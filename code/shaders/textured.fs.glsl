@@ -1,16 +1,20 @@
 #version 330
-#define NUM_OF_LIGHTS 8
+#define MAX_LIGHTS 32
 
 // From vertex shader
 in vec2 texcoord;
-in vec4 worldPos;
+in vec2 lightCoord;
 
 
 // Application data
 uniform sampler2D sampler0;
 uniform vec3 fcolor;
-uniform bool hasLights;
-uniform vec3 lights[NUM_OF_LIGHTS]; // xy - position, z - intensity
+uniform sampler2D light_buffer; // r - light intensity, g - bright radius, from the light pass
+layout(std140) uniform LightBlock
+{
+	vec4 lights[MAX_LIGHTS]; // xy - position, z - drop-off exponent
+	int lightCount;
+};
 
 // Output color
 layout(location = 0) out  vec4 color;
@@ -19,32 +23,15 @@ void main()
 {
 	color = vec4(fcolor, 1) * texture(sampler0, vec2(texcoord.x, texcoord.y));
 
-	if (hasLights) 
+	if (lightCount > 0) 
 	{
-		bool isLit = false;
-		vec3 baseColor = vec3(0.01, 0.01, 0.0);
-		for (int i = 0; i < NUM_OF_LIGHTS; i++) 
-		{
-			vec3 light = lights[i];
-			float dist = distance(worldPos.xy, light.xy);
-
-			// darker at larger distance, larger drop-off value simulates smaller light source
-			float lightIntensity = 300.0 / pow(dist, light.z);
-
-			baseColor.xyz += lightIntensity * color.xyz;
-		
-			if (dist < light.z * 100.0) 
-			{
-				isLit = true;
-			}
-		}
-		color.xyz = vec3(min(baseColor.x, 1), min(baseColor.y, 1), min(baseColor.z, 1));
-
-		
-		if (isLit) 
-		{
-			color.z /= 1.3; // slightly yellow tinge
-		}
-		
+		// Accumulated for all lights at a lower resolution by the light pass
+		vec2 light = texture(light_buffer, lightCoord).rg;
+		// premultiplied, so the ambient term and the clamp scale with alpha
+		vec3 baseColor = vec3(0.01, 0.01, 0.0) * color.a + light.r * color.xyz;
+		color.xyz = min(baseColor, vec3(color.a));
+
+		// slightly yellow tinge, filtered at the edge of the bright radius
+		color.z /= mix(1.0, 1.3, min(light.g, 1.0));
 	}
 }
@@ -1,21 +1,24 @@
 #version 330
 
 // Input attributes
-in vec3 in_position;
-in vec2 in_texcoord;
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec2 in_texcoord;
 
 // Passed to fragment shader
 out vec2 texcoord;
-out vec4 worldPos;
+out vec2 lightCoord; // world position in the light buffer
 
 // Application data
 uniform mat3 transform;
 uniform mat3 projection;
+uniform mat3 light_projection; // projection of the light pass, the player camera's
+uniform vec4 uv_rect; // offset (xy) and scale (zw) of the sprite sheet frame, (0, 0, 1, 1) otherwise
 
 void main()
 {
-	texcoord = in_texcoord;
-	worldPos = vec4(transform * vec3(in_position.xy, 1.0), 1.0);
-	vec3 pos = projection * transform * vec3(in_position.xy, 1.0);
+	texcoord = uv_rect.xy + in_texcoord * uv_rect.zw;
+	vec3 world_pos = transform * vec3(in_position.xy, 1.0);
+	vec3 pos = projection * world_pos;
 	gl_Position = vec4(pos.xy, in_position.z, 1.0);
+	lightCoord = (light_projection * world_pos).xy * 0.5 + 0.5;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@ uniform sampler2D screen_texture;
 uniform float time;
 uniform float screen_darken_factor;
 uniform bool is_poisoned;
+uniform float frame_scale; // part of the screen texture the frame was drawn into
 
 in vec2 texcoord;
 
@@ -44,7 +45,8 @@ vec4 fade_color(vec4 in_color)
 
 void main()
 {
-		vec2 coord = distort(texcoord);
+		// upscaled from the frame's corner of the texture, without filtering in what's beyond it
+		vec2 coord = min(distort(texcoord) * frame_scale, vec2(frame_scale) - 0.5 / vec2(textureSize(screen_texture, 0)));
 		vec4 in_color = texture(screen_texture, coord);
 		color = color_shift(in_color);
 		color = fade_color(color);
@@ -1,7 +1,123 @@
 // internal
 #include "ai_system.hpp"
+#include "world_init.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void AISystem::init(RenderSystem* renderer_arg)
+{
+	this->renderer = renderer_arg;
+}
 
 void AISystem::step(float elapsed_ms)
 {
-	(void)elapsed_ms; // placeholder to silence unused warning until implemented
-}
\ No newline at end of file
+	(void)elapsed_ms;
+
+	// Rebuild the neighbour grid from this frame's zombie positions
+	zombie_grid.setCellSize(SEPARATION_RADIUS);
+	zombie_grid.clear();
+	auto& zombie_container = registry.zombies;
+	for (uint i = 0; i < zombie_container.size(); i++)
+	{
+		Entity entity = zombie_container.entities[i];
+		if (!registry.motions.has(entity))
+			continue;
+		zombie_grid.add(entity, registry.motions.get(entity).position);
+	}
+	zombie_grid.build();
+
+	// Compute all steering from the velocities chosen by WorldSystem before writing any back,
+	// so the result doesn't depend on iteration order
+	std::vector<std::pair<Entity, float>> steering;
+	for (uint i = 0; i < zombie_container.size(); i++)
+	{
+		Entity entity = zombie_container.entities[i];
+		Zombie& zombie = zombie_container.components[i];
+		if (!registry.motions.has(entity) || registry.zombieDeathTimers.has(entity))
+			continue;
+		// Zombies that skipped their update this frame keep last frame's (already steered) velocity
+		if (registry.aiLods.has(entity) && !registry.aiLods.get(entity).tick)
+			continue;
+
+		Motion& motion = registry.motions.get(entity);
+		// Idle zombies stay put and climbing/blocked zombies are handled by WorldSystem
+		if (motion.velocity.x == 0.f || motion.climbing || zombie.left_side_collision || zombie.right_side_collision)
+			continue;
+
+		// +1 since the zombie finds itself
+		neighbours.clear();
+		int count = zombie_grid.query(motion.position, SEPARATION_RADIUS, neighbours, MAX_NEIGHBOURS + 1);
+
+		float separation = 0.f;
+		float alignment = 0.f;
+		int num_neighbours = 0;
+		for (int n = 0; n < count; n++)
+		{
+			Entity other = neighbours[n].entity;
+			if (other == entity)
+				continue;
+			vec2 offset = motion.position - neighbours[n].position;
+			if (std::abs(offset.y) > NEIGHBOUR_MAX_DY)
+				continue;
+
+			// Push away harder the closer the neighbour, pick a side for exact overlaps
+			float dx = offset.x != 0.f ? offset.x : ((unsigned int)entity < (unsigned int)other ? -1.f : 1.f);
+			float side = dx > 0.f ? 1.f : -1.f;
+			separation += side * (SEPARATION_RADIUS - std::abs(dx)) / SEPARATION_RADIUS;
+			alignment += registry.motions.get(other).velocity.x;
+			num_neighbours++;
+		}
+		if (num_neighbours == 0)
+			continue;
+
+		alignment = alignment / num_neighbours - motion.velocity.x;
+		float steer = SEPARATION_WEIGHT * ZOMBIE_SPEED * separation + ALIGNMENT_WEIGHT * alignment;
+		steer = std::min(std::max(steer, -MAX_STEERING_SPEED), MAX_STEERING_SPEED);
+		steering.push_back({ entity, steer });
+	}
+
+	for (auto& s : steering)
+	{
+		Motion& motion = registry.motions.get(s.first);
+		float direction = motion.velocity.x > 0.f ? 1.f : -1.f;
+		float speed = direction * (motion.velocity.x + s.second);
+		motion.velocity.x = direction * std::min(std::max(speed, 0.f), std::abs(motion.velocity.x) + MAX_STEERING_SPEED);
+	}
+
+	updateLevelOfDetail();
+}
+
+// Picks the tier of every zombie for the next frame
+void AISystem::updateLevelOfDetail()
+{
+	frame++;
+	if (registry.players.entities.size() == 0 || !registry.motions.has(registry.players.entities[0]))
+		return;
+
+	vec2 player_position = registry.motions.get(registry.players.entities[0]).position;
+	vec4 camera = renderer ? renderer->getCameraBounds() : vec4(0.f, 0.f, window_width_px, window_height_px);
+
+	for (uint i = 0; i < registry.aiLods.size(); i++)
+	{
+		Entity entity = registry.aiLods.entities[i];
+		AILod& lod = registry.aiLods.components[i];
+		if (!registry.motions.has(entity))
+			continue;
+
+		const Motion& motion = registry.motions.get(entity);
+		vec2 position = motion.position;
+		bool visible = position.x >= camera.x - LOD_CAMERA_MARGIN && position.x <= camera.z + LOD_CAMERA_MARGIN &&
+			position.y >= camera.y - LOD_CAMERA_MARGIN && position.y <= camera.w + LOD_CAMERA_MARGIN;
+
+		if (visible)
+			lod.tick_interval = LOD_NEAR_INTERVAL;
+		else if (distance(position, player_position) < LOD_MID_DISTANCE)
+			lod.tick_interval = LOD_MID_INTERVAL;
+		else
+			lod.tick_interval = LOD_FAR_INTERVAL;
+
+		// Climbing zombies decide every frame where to get off the ladder
+		lod.tick = motion.climbing || (frame + lod.phase) % lod.tick_interval == 0;
+	}
+}
@@ -4,13 +4,46 @@
 
 #include "tiny_ecs_registry.hpp"
 #include "common.hpp"
+#include "spatial_grid.hpp"
+#include "render_system.hpp"
 
-// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-// DON'T WORRY ABOUT THIS CLASS UNTIL ASSIGNMENT 3
-// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-
+// Boids style crowd steering for the zombies. WorldSystem::updateZombieMovement picks
+// the chase velocity, this system then nudges velocity.x so that zombies chasing the
+// same target spread out instead of stacking on top of each other.
+// It also assigns every zombie an AILod tier that decides how often its decision
+// logic in WorldSystem runs.
 class AISystem
 {
 public:
+	void init(RenderSystem* renderer);
+
 	void step(float elapsed_ms);
-};
\ No newline at end of file
+
+	// Tick intervals (in frames) of the AI level of detail tiers
+	static const int LOD_NEAR_INTERVAL = 1;  // visible on screen
+	static const int LOD_MID_INTERVAL = 4;   // off screen but close to the player
+	static const int LOD_FAR_INTERVAL = 16;  // everything else
+	const float LOD_MID_DISTANCE = 600.f;
+	// Zombies slightly outside of the camera still count as visible so they don't walk in stale
+	const float LOD_CAMERA_MARGIN = 100.f;
+
+	// Zombies closer than this push each other apart
+	const float SEPARATION_RADIUS = 50.f;
+	// Only neighbours on roughly the same floor count
+	const float NEIGHBOUR_MAX_DY = 35.f;
+	// Bound on neighbours considered per zombie, keeps dense hordes linear
+	static const int MAX_NEIGHBOURS = 8;
+
+	const float SEPARATION_WEIGHT = 0.6f;
+	const float ALIGNMENT_WEIGHT = 0.15f;
+	// Steering can slow a zombie down but never turns it around or speeds it past this
+	const float MAX_STEERING_SPEED = 60.f;
+
+private:
+	void updateLevelOfDetail();
+
+	RenderSystem* renderer = nullptr;
+	SpatialGrid zombie_grid;
+	std::vector<SpatialGrid::Item> neighbours;
+	unsigned int frame = 0;
+};
@@ -1,5 +1,10 @@
 #include "common.hpp"
 
+#include <cstring>
+
+unsigned int gl_state_query_count = 0;
+unsigned int gl_error_query_count = 0;
+
 // Note, we could also use the functions from GLM but we write the transformations here to show the uderlying math
 void Transform::scale(vec2 scale)
 {
@@ -37,9 +42,10 @@ void Transform::reflect(vec2 direction)
 	mat = mat * R;
 }
 
-bool gl_has_errors()
+bool gl_check_errors(const char* file, int line)
 { 
 	GLenum error = glGetError();
+	gl_error_query_count++;
 
 	if (error == GL_NO_ERROR) return false;
 
@@ -65,10 +71,83 @@ bool gl_has_errors()
 			break;
 		}
 
-		fprintf(stderr, "OpenGL: %s", error_str);
+		fprintf(stderr, "OpenGL: %s at %s:%d\n", error_str, file, line);
 		error = glGetError();
+		gl_error_query_count++;
 		assert(false);
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+namespace
+{
+	bool debug_output_enabled = false;
+	// Location of the last gl_has_errors(), errors reported by the callback happened after it
+	const char* checkpoint_file = "(before the first check)";
+	int checkpoint_line = 0;
+	int pending_errors = 0;
+
+	void APIENTRY debugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+		GLsizei length, const GLchar* message, const void* user_param)
+	{
+		(void)source; (void)id; (void)length; (void)user_param;
+		if (type != GL_DEBUG_TYPE_ERROR && severity != GL_DEBUG_SEVERITY_HIGH)
+			return;
+		fprintf(stderr, "OpenGL: %s (after %s:%d)\n", message, checkpoint_file, checkpoint_line);
+		if (type == GL_DEBUG_TYPE_ERROR)
+			pending_errors++;
+	}
+
+	// The entry points can be loaded without the driver exposing the extension, so
+	// KHR_debug is only used from GL 4.3 contexts or when it is in the extension list
+	bool hasDebugOutput()
+	{
+		if (gl3w_is_supported(4, 3))
+			return true;
+		GLint extension_count = 0;
+		gl_state_query(glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count));
+		for (GLint i = 0; i < extension_count; i++)
+		{
+			const GLubyte* extension = gl_state_query(glGetStringi(GL_EXTENSIONS, (GLuint)i));
+			if (extension != nullptr && strcmp((const char*)extension, "GL_KHR_debug") == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+bool gl_enable_debug_output()
+{
+#if !defined(NDEBUG) && !defined(UBZ_GL_ERROR_CHECKS)
+	// Needs GL 4.3 or KHR_debug and a debug context, macOS has neither
+	if (!hasDebugOutput() || glDebugMessageCallback == nullptr || glDebugMessageControl == nullptr)
+	{
+		printf("KHR_debug is not available, GL errors are checked with glGetError\n");
+		return false;
+	}
+	glEnable(GL_DEBUG_OUTPUT);
+	// The callback runs inside the failing call, so the last checkpoint is right before it
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	glDebugMessageCallback(debugMessageCallback, nullptr);
+	debug_output_enabled = true;
+#endif
+	return debug_output_enabled;
+}
+
+bool gl_debug_checkpoint(const char* file, int line)
+{
+	if (!debug_output_enabled)
+		return gl_check_errors(file, line);
+
+	checkpoint_file = file;
+	checkpoint_line = line;
+	if (pending_errors == 0)
+		return false;
+
+	// Stop here, the error was reported when it happened
+	pending_errors = 0;
+	assert(false);
+	return true;
+}
@@ -27,6 +27,12 @@ using namespace glm;
 inline std::string data_path() { return std::string(PROJECT_SOURCE_DIR) + "data"; };
 inline std::string shader_path(const std::string& name) {return std::string(PROJECT_SOURCE_DIR) + "/shaders/" + name;};
 inline std::string textures_path(const std::string& name) {return data_path() + "/textures/" + std::string(name);};
+// The build puts the cooked textures next to the game (UBZ_COOKED_TEXTURES_DIR)
+#ifdef UBZ_COOKED_TEXTURES_DIR
+inline std::string cooked_textures_path(const std::string& name) {return std::string(UBZ_COOKED_TEXTURES_DIR) + name;};
+#else
+inline std::string cooked_textures_path(const std::string& name) {return data_path() + "/cooked_textures/" + std::string(name);};
+#endif
 inline std::string audio_path(const std::string& name) {return data_path() + "/audio/" + std::string(name);};
 inline std::string mesh_path(const std::string& name) {return data_path() + "/meshes/" + std::string(name);};
 inline std::string level_path(const std::string& name) {return data_path() + "/levels/" + std::string(name);};
@@ -57,4 +63,31 @@ struct Transform {
 	void reflect(vec2 yDirection);
 };
 
-bool gl_has_errors();
+// GL error checking, gl_has_errors() goes after GL calls:
+//  - debug builds report errors through a KHR_debug callback as they happen, the call only
+//    records its location so the callback can tell where the error came from
+//  - release builds (NDEBUG) compile the checks out
+//  - UBZ_GL_ERROR_CHECKS, or a debug build without KHR_debug, calls glGetError every time
+bool gl_check_errors(const char* file, int line);
+bool gl_debug_checkpoint(const char* file, int line);
+inline bool gl_no_error_check() { return false; }
+#if defined(UBZ_GL_ERROR_CHECKS)
+#define gl_has_errors() gl_check_errors(__FILE__, __LINE__)
+#elif !defined(NDEBUG)
+#define gl_has_errors() gl_debug_checkpoint(__FILE__, __LINE__)
+#else
+#define gl_has_errors() gl_no_error_check()
+#endif
+
+// Installs the KHR_debug callback in debug builds, call once the context is current.
+// Returns false if the checks fall back to glGetError.
+bool gl_enable_debug_output();
+
+// Synchronous GL queries wait for the driver to catch up, so they are counted to keep
+// them out of the per frame code. The renderer reports the per frame counts in RenderStats.
+extern unsigned int gl_state_query_count; // glGet* calls on buffers, programs and other state
+extern unsigned int gl_error_query_count; // glGetError calls of gl_has_errors()
+
+// Every glGet* other than glGetError goes through this so it shows up in gl_state_query_count:
+//   gl_state_query(glGetProgramiv(program, GL_LINK_STATUS, &is_linked));
+#define gl_state_query(call) (gl_state_query_count++, call)
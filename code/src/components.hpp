@@ -25,6 +25,23 @@ struct Zombie
 	bool left_side_collision = false;
 };
 
+// AI level of detail, far away zombies only re-run their decision logic every tick_interval frames
+// and keep moving with their last velocity in between. What the logic decided is kept here so
+// that getting on a ladder, jumping and turning at edges are still checked every frame.
+struct AILod
+{
+	int tick_interval = 1;
+	int phase = 0; // spreads zombies of the same tier over different frames
+	bool tick = true; // run the decision logic this frame
+
+	int level = 0; // floor the zombie was last on
+	bool has_ladder = false; // heading for the ladder at ladder_x
+	float ladder_x = 0.f;
+	float ladder_snap = 10.f; // gets on the ladder once this close to it
+	float ladder_step_y = 0.f; // moved by this much when getting on
+	float ladder_velocity_y = 0.f;
+};
+
 // Player and Student(s) are Human
 struct Human
 {
@@ -508,7 +525,10 @@ enum class EFFECT_ASSET_ID
 	OVERLAY_TEXTURED = TEXTURED + 1,
 	BLENDED = OVERLAY_TEXTURED + 1,
 	WATER = BLENDED + 1,
-	EFFECT_COUNT = WATER + 1
+	SPRITE_BATCH = WATER + 1, // instanced TEXTURED/OVERLAY_TEXTURED/BLENDED sprites, not requested directly
+	LIGHT_ACCUMULATION = SPRITE_BATCH + 1, // light pass, not requested directly
+	PARALLAX = LIGHT_ACCUMULATION + 1, // all full screen backgrounds in one pass, not requested directly
+	EFFECT_COUNT = PARALLAX + 1
 };
 const int effect_count = (int)EFFECT_ASSET_ID::EFFECT_COUNT;
 
@@ -523,11 +543,34 @@ enum class GEOMETRY_BUFFER_ID {
 };
 const int geometry_count = (int)GEOMETRY_BUFFER_ID::GEOMETRY_COUNT;
 
+// Render layers, drawn back to front. Within a layer requests are drawn by their order
+// and then grouped by GPU state, so anything that has to overlap in a fixed way needs
+// its own layer or order.
+enum class RENDER_LAYER {
+	BACKGROUND = 0, // level backgrounds, order is their position in the level's list
+	BACKGROUND_PROPS = BACKGROUND + 1, // lights, buses, animated props, cutscenes
+	LEVEL = BACKGROUND_PROPS + 1, // platforms, then walls, then doors, then climbables
+	HAZARDS = LEVEL + 1, // spikes and wheels
+	ITEMS = HAZARDS + 1, // collectibles in the level
+	CHARACTERS = ITEMS + 1, // boss, zombies and students
+	PLAYER = CHARACTERS + 1, // bozo, then the aiming pointer
+	PROJECTILES = PLAYER + 1, // thrown books and moving dangers
+	WORLD_UI = PROJECTILES + 1, // boss health, then its frame
+	OVERLAY_BACKGROUND = WORLD_UI + 1, // menu and pause backdrops
+	OVERLAY = OVERLAY_BACKGROUND + 1, // HUD, labels and buttons, then hearts, then the loading screen
+	LAYER_COUNT = OVERLAY + 1
+};
+const int render_layer_count = (int)RENDER_LAYER::LAYER_COUNT;
+
 struct RenderRequest
 {
 	TEXTURE_ASSET_ID used_texture = TEXTURE_ASSET_ID::TEXTURE_COUNT;
 	EFFECT_ASSET_ID used_effect = EFFECT_ASSET_ID::EFFECT_COUNT;
 	GEOMETRY_BUFFER_ID used_geometry = GEOMETRY_BUFFER_ID::GEOMETRY_COUNT;
+	RENDER_LAYER layer = RENDER_LAYER::CHARACTERS;
+	uint16_t order = 0; // draw order within the layer
+	bool in_static_grid = false; // culled through RenderSystem's static visibility grid
+	bool baked = false; // drawn from RenderSystem's baked static level buffer
 };
 
 enum class ANIMATION_MODE
@@ -555,13 +598,11 @@ struct SpriteSheet
 	vec2 spriteDim = { -1.f, -1.f };
 	vec2 truncation;
 	std::vector<int> spriteCount;
-	uint bufferId;
 	ANIMATION_MODE mode = ANIMATION_MODE::IDLE;
 	bool loop = true;
 
-	SpriteSheet(uint bId, ANIMATION_MODE defaultMode, std::vector<int>& spriteCt, float switchTime, vec2 trunc)
+	SpriteSheet(ANIMATION_MODE defaultMode, std::vector<int>& spriteCt, float switchTime, vec2 trunc)
 	{
-		bufferId = bId;
 		spriteCount = spriteCt;
 		switchTime_ms = switchTime;
 		truncation = trunc;
@@ -589,4 +630,10 @@ struct SpriteSheet
 		else
 			return 0;
 	}
+
+	// Texture coordinates of the current frame as offset (xy) and scale (zw) of the
+	// sprite quad's coordinates, all sprite sheets share the regular sprite geometry
+	vec4 getUVRect() const {
+		return { offset.x, offset.y + truncation.y, spriteDim.x - truncation.x, spriteDim.y - truncation.y };
+	}
 };
\ No newline at end of file
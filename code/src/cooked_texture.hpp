@@ -0,0 +1,79 @@
+#pragma once
+
+// Cooked textures, written by tools/texture_cooker and read by TextureStreamer. Also built
+// into the cooker, so this header only uses the standard library.
+//
+// A cooked texture is named after the FNV-1a hash of its source file, an edited source gets
+// a new name and the stale file is never looked at. The file is a CookedTextureHeader
+// followed by every mip level, largest first, as premultiplied RGBA8 rows top first.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+const uint32_t COOKED_TEXTURE_MAGIC = 0x58455455; // "UTEX"
+const uint32_t COOKED_TEXTURE_VERSION = 1;
+
+struct CookedTextureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_count;
+	uint32_t padding[3];
+};
+
+inline uint64_t fnv1aHash(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline std::string cookedTextureName(uint64_t source_hash)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.utex", (unsigned long long)source_hash);
+	return name;
+}
+
+inline uint32_t mipSize(uint32_t size, uint32_t level)
+{
+	uint32_t mip = size >> level;
+	return mip > 0 ? mip : 1;
+}
+
+// Levels of a full mip chain, down to 1x1
+inline uint32_t mipCount(uint32_t width, uint32_t height)
+{
+	uint32_t count = 1;
+	while ((width >> count) > 0 || (height >> count) > 0)
+		count++;
+	return count;
+}
+
+// Bytes of all mip levels of a width x height RGBA8 texture
+inline size_t mipChainBytes(uint32_t width, uint32_t height, uint32_t mip_count)
+{
+	size_t bytes = 0;
+	for (uint32_t level = 0; level < mip_count; level++)
+		bytes += (size_t)mipSize(width, level) * mipSize(height, level) * 4;
+	return bytes;
+}
+
+// Scales the colour of every RGBA8 pixel by its alpha
+inline void premultiplyAlpha(unsigned char* rgba, size_t pixel_count)
+{
+	for (size_t i = 0; i < pixel_count; i++)
+	{
+		unsigned char* pixel = &rgba[i * 4];
+		for (int c = 0; c < 3; c++)
+			pixel[c] = (unsigned char)((pixel[c] * pixel[3] + 127) / 255);
+	}
+}
@@ -0,0 +1,69 @@
+// internal
+#include "dynamic_resolution.hpp"
+
+// stlib
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::init()
+{
+	glGenQueries(QUERY_COUNT, queries.data());
+	gl_has_errors();
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	if (queries[0] != 0)
+		glDeleteQueries(QUERY_COUNT, queries.data());
+}
+
+void DynamicResolution::beginFrame()
+{
+	// Collect the result of the frame that last used this slot, if it is still in flight the
+	// frame goes unmeasured rather than waiting for it
+	const GLuint query = queries[next_query];
+	if (query_pending[next_query])
+	{
+		GLint available = 0;
+		gl_state_query(glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available));
+		if (!available)
+			return;
+		GLuint64 elapsed_ns = 0;
+		gl_state_query(glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_ns));
+		query_pending[next_query] = false;
+		addMeasurement((float)(elapsed_ns / 1e6));
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	measuring = true;
+}
+
+void DynamicResolution::endFrame()
+{
+	if (!measuring)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	gl_has_errors();
+	measuring = false;
+	query_pending[next_query] = true;
+	next_query = (next_query + 1) % QUERY_COUNT;
+}
+
+void DynamicResolution::addMeasurement(float ms)
+{
+	measured_ms += ms;
+	if (++measured_frames < RENDER_SCALE_ADJUST_FRAMES)
+		return;
+	gpu_frame_ms = measured_ms / measured_frames;
+	measured_ms = 0.f;
+	measured_frames = 0;
+
+	// Most of the frame's cost is per pixel, so its time follows the area, scale squared.
+	// Only scale back up once there is some headroom, or it would bounce around the target.
+	float wanted = scale;
+	if (gpu_frame_ms > target_ms || gpu_frame_ms < target_ms * 0.8f)
+		wanted = scale * sqrtf(target_ms * 0.9f / std::max(gpu_frame_ms, 0.01f));
+	wanted = std::min(std::max(wanted, MIN_RENDER_SCALE), 1.f);
+	if (fabsf(wanted - scale) >= RENDER_SCALE_STEP || (wanted != scale && (wanted == 1.f || wanted == MIN_RENDER_SCALE)))
+		scale = wanted;
+}
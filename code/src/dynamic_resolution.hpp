@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+
+#include "common.hpp"
+
+// Frames are drawn at a fraction of the window's resolution while the GPU can't keep up,
+// then scaled up to the window by the screen pass
+const float MIN_RENDER_SCALE = 0.5f;
+// GPU time per frame the scale is adjusted towards, leaves headroom under a 60 Hz frame
+const float DEFAULT_GPU_FRAME_TARGET_MS = 14.f;
+// The scale only changes once per this many measured frames, by at least RENDER_SCALE_STEP
+const int RENDER_SCALE_ADJUST_FRAMES = 30;
+const float RENDER_SCALE_STEP = 0.05f;
+
+// Picks the resolution scale of the frame from GPU frame times, measured with GL_TIME_ELAPSED
+// queries. Results are read a few frames later, once GL has them, so measuring never stalls.
+class DynamicResolution
+{
+public:
+	// Creates the queries, call with the GL context current
+	void init();
+	~DynamicResolution();
+
+	// Time the GPU work issued in between, at most once per frame
+	void beginFrame();
+	void endFrame();
+
+	// Scale of both sides of the frame, MIN_RENDER_SCALE to 1
+	float getScale() const { return fixed_scale > 0.f ? fixed_scale : scale; }
+	// Average GPU time of the last RENDER_SCALE_ADJUST_FRAMES measured frames
+	float getGpuFrameMs() const { return gpu_frame_ms; }
+
+	void setTarget(float ms) { target_ms = ms; }
+	// Draw every frame at this scale instead, 0 to go back to adjusting it
+	void setFixedScale(float fixed) { fixed_scale = fixed; }
+
+private:
+	void addMeasurement(float ms);
+
+	// Enough in flight that the oldest has finished by the time its slot comes around again
+	static const int QUERY_COUNT = 4;
+	std::array<GLuint, QUERY_COUNT> queries = {};
+	std::array<bool, QUERY_COUNT> query_pending = {};
+	int next_query = 0;
+	bool measuring = false;
+
+	float scale = 1.f;
+	float fixed_scale = 0.f;
+	float target_ms = DEFAULT_GPU_FRAME_TARGET_MS;
+	float gpu_frame_ms = 0.f;
+	float measured_ms = 0.f;
+	int measured_frames = 0;
+};
@@ -0,0 +1,121 @@
+// internal
+#include "frame_profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+const char* PROFILER_SYSTEM_NAMES[FrameProfiler::SYSTEM_COUNT] = { "world", "ai", "physics", "render" };
+
+void FrameProfiler::beginRun(int zombies, int npcs, int frames, int warmup_frames)
+{
+	Run run;
+	run.zombies = zombies;
+	run.npcs = npcs;
+	runs.push_back(run);
+	frames_left = frames;
+	warmup_left = warmup_frames;
+	frame_ms.fill(0.0);
+	running = true;
+}
+
+void FrameProfiler::begin(SYSTEM system)
+{
+	start_times[system] = Clock::now();
+}
+
+void FrameProfiler::end(SYSTEM system)
+{
+	auto now = Clock::now();
+	frame_ms[system] += std::chrono::duration_cast<std::chrono::microseconds>(now - start_times[system]).count() / 1000.0;
+}
+
+void FrameProfiler::setRenderCounters(int draw_calls, int gl_state_queries, int visible_sprites, int total_sprites)
+{
+	frame_draw_calls = draw_calls;
+	frame_gl_state_queries = gl_state_queries;
+	frame_visible_sprites = visible_sprites;
+	frame_total_sprites = total_sprites;
+}
+
+bool FrameProfiler::endFrame()
+{
+	if (!running)
+		return false;
+
+	if (warmup_left > 0)
+	{
+		warmup_left--;
+		frame_ms.fill(0.0);
+		return false;
+	}
+
+	Run& run = runs.back();
+	double frame_total = 0.0;
+	for (int i = 0; i < SYSTEM_COUNT; i++)
+	{
+		run.total_ms[i] += frame_ms[i];
+		run.max_ms[i] = std::max(run.max_ms[i], frame_ms[i]);
+		frame_total += frame_ms[i];
+	}
+	run.frame_total_ms += frame_total;
+	run.frame_max_ms = std::max(run.frame_max_ms, frame_total);
+	run.draw_calls += frame_draw_calls;
+	run.max_gl_state_queries = std::max(run.max_gl_state_queries, frame_gl_state_queries);
+	run.visible_sprites += frame_visible_sprites;
+	run.total_sprites += frame_total_sprites;
+	run.frames++;
+	frame_ms.fill(0.0);
+
+	if (--frames_left <= 0)
+	{
+		running = false;
+		return true;
+	}
+	return false;
+}
+
+void FrameProfiler::report(const std::string& csv_path) const
+{
+	printf("\n%8s %8s %7s", "zombies", "npcs", "frames");
+	for (int i = 0; i < SYSTEM_COUNT; i++)
+		printf(" %9s avg/max", PROFILER_SYSTEM_NAMES[i]);
+	printf("     frame avg/max (ms)    draws  gl queries  visible/total sprites\n");
+
+	for (const Run& run : runs)
+	{
+		if (run.frames == 0)
+			continue;
+		printf("%8d %8d %7d", run.zombies, run.npcs, run.frames);
+		for (int i = 0; i < SYSTEM_COUNT; i++)
+			printf(" %8.3f/%-8.3f", run.total_ms[i] / run.frames, run.max_ms[i]);
+		printf(" %8.3f/%-8.3f", run.frame_total_ms / run.frames, run.frame_max_ms);
+		printf(" %8.1f %11d", (double)run.draw_calls / run.frames, run.max_gl_state_queries);
+		printf(" %10.1f/%-10.1f\n", (double)run.visible_sprites / run.frames, (double)run.total_sprites / run.frames);
+	}
+
+	if (csv_path.empty())
+		return;
+	FILE* file = fopen(csv_path.c_str(), "w");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", csv_path.c_str());
+		return;
+	}
+	fprintf(file, "zombies,npcs,frames");
+	for (int i = 0; i < SYSTEM_COUNT; i++)
+		fprintf(file, ",%s_avg_ms,%s_max_ms", PROFILER_SYSTEM_NAMES[i], PROFILER_SYSTEM_NAMES[i]);
+	fprintf(file, ",frame_avg_ms,frame_max_ms,draw_calls_avg,gl_state_queries_max,visible_sprites_avg,total_sprites_avg\n");
+	for (const Run& run : runs)
+	{
+		if (run.frames == 0)
+			continue;
+		fprintf(file, "%d,%d,%d", run.zombies, run.npcs, run.frames);
+		for (int i = 0; i < SYSTEM_COUNT; i++)
+			fprintf(file, ",%.4f,%.4f", run.total_ms[i] / run.frames, run.max_ms[i]);
+		fprintf(file, ",%.4f,%.4f", run.frame_total_ms / run.frames, run.frame_max_ms);
+		fprintf(file, ",%.1f,%d", (double)run.draw_calls / run.frames, run.max_gl_state_queries);
+		fprintf(file, ",%.1f,%.1f\n", (double)run.visible_sprites / run.frames, (double)run.total_sprites / run.frames);
+	}
+	fclose(file);
+	printf("Wrote stress test results to %s\n", csv_path.c_str());
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Records how long each system takes per frame. Used by the stress test mode to see
+// how the systems scale with the number of agents in a level.
+class FrameProfiler
+{
+public:
+	enum SYSTEM
+	{
+		WORLD = 0,
+		AI = WORLD + 1,
+		PHYSICS = AI + 1,
+		RENDER = PHYSICS + 1,
+		SYSTEM_COUNT = RENDER + 1
+	};
+
+	// Summary of one run (a fixed number of frames with the same agent count)
+	struct Run
+	{
+		int zombies = 0;
+		int npcs = 0;
+		int frames = 0;
+		std::array<double, SYSTEM_COUNT> total_ms = {};
+		std::array<double, SYSTEM_COUNT> max_ms = {};
+		double frame_total_ms = 0.0;
+		double frame_max_ms = 0.0;
+		long long draw_calls = 0;
+		int max_gl_state_queries = 0;
+		long long visible_sprites = 0;
+		long long total_sprites = 0;
+	};
+
+	// Starts a new run, warmup_frames are timed but not recorded (level load, first uploads)
+	void beginRun(int zombies, int npcs, int frames, int warmup_frames = 30);
+
+	// Time the system between begin() and end()
+	void begin(SYSTEM system);
+	void end(SYSTEM system);
+
+	// Renderer counters of the current frame, call before endFrame()
+	void setRenderCounters(int draw_calls, int gl_state_queries, int visible_sprites, int total_sprites);
+
+	// Call once at the end of every frame, returns true when the current run is complete
+	bool endFrame();
+
+	bool isRunning() const { return running; }
+	const std::vector<Run>& getRuns() const { return runs; }
+
+	// Prints a table of the average and worst frame times of all runs, and writes it to
+	// csv_path as well if given
+	void report(const std::string& csv_path = "") const;
+
+private:
+	using Clock = std::chrono::high_resolution_clock;
+
+	std::vector<Run> runs;
+	std::array<Clock::time_point, SYSTEM_COUNT> start_times;
+	std::array<double, SYSTEM_COUNT> frame_ms = {};
+	int frame_draw_calls = 0;
+	int frame_gl_state_queries = 0;
+	int frame_visible_sprites = 0;
+	int frame_total_sprites = 0;
+	int frames_left = 0;
+	int warmup_left = 0;
+	bool running = false;
+};
+
+extern const char* PROFILER_SYSTEM_NAMES[FrameProfiler::SYSTEM_COUNT];
@@ -0,0 +1,75 @@
+// internal
+#include "headless.hpp"
+
+#include "../ext/stb_image/stb_image.h"
+
+// stlib
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+// Same layout as the atlas packer's pages: top left origin, stb_image reads it back top row first
+bool writeFrameTGA(const std::string& path, const std::vector<uint8_t>& rgba, ivec2 size)
+{
+	assert(rgba.size() == (size_t)size.x * size.y * 4);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+	unsigned char header[18] = {};
+	header[2] = 2; // uncompressed true colour
+	header[12] = size.x & 0xff;
+	header[13] = (size.x >> 8) & 0xff;
+	header[14] = size.y & 0xff;
+	header[15] = (size.y >> 8) & 0xff;
+	header[16] = 32;
+	header[17] = 0x28; // 8 alpha bits, top left origin
+	fwrite(header, 1, sizeof(header), file);
+
+	std::vector<uint8_t> bgra(rgba.size());
+	for (size_t i = 0; i < rgba.size(); i += 4)
+	{
+		bgra[i + 0] = rgba[i + 2];
+		bgra[i + 1] = rgba[i + 1];
+		bgra[i + 2] = rgba[i + 0];
+		bgra[i + 3] = rgba[i + 3];
+	}
+	fwrite(bgra.data(), 1, bgra.size(), file);
+	fclose(file);
+	return true;
+}
+
+float compareWithGolden(const std::string& golden_path, const std::vector<uint8_t>& rgba, ivec2 size, int tolerance)
+{
+	ivec2 golden_size;
+	stbi_uc* golden = stbi_load(golden_path.c_str(), &golden_size.x, &golden_size.y, NULL, 4);
+	if (golden == NULL)
+	{
+		fprintf(stderr, "Failed to load golden image %s\n", golden_path.c_str());
+		return -1.f;
+	}
+	if (golden_size != size)
+	{
+		fprintf(stderr, "Golden image %s is %dx%d, the frame is %dx%d\n", golden_path.c_str(), golden_size.x, golden_size.y, size.x, size.y);
+		stbi_image_free(golden);
+		return -1.f;
+	}
+
+	size_t pixel_count = (size_t)size.x * size.y;
+	size_t differing = 0;
+	for (size_t i = 0; i < pixel_count; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			if (abs((int)golden[i * 4 + c] - (int)rgba[i * 4 + c]) > tolerance)
+			{
+				differing++;
+				break;
+			}
+		}
+	}
+	stbi_image_free(golden);
+	return (float)differing / (float)pixel_count;
+}
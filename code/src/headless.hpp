@@ -0,0 +1,16 @@
+#pragma once
+
+// stlib
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+
+// Frame captures of the headless render benchmark. The frames are RGBA, top row first.
+
+// Writes the frame as an uncompressed 32 bit TGA
+bool writeFrameTGA(const std::string& path, const std::vector<uint8_t>& rgba, ivec2 size);
+
+// Compares the frame with a golden image, returns the fraction of pixels where any channel
+// differs by more than tolerance, or -1 if the golden could not be loaded or has another size
+float compareWithGolden(const std::string& golden_path, const std::vector<uint8_t>& rgba, ivec2 size, int tolerance);
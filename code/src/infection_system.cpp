@@ -0,0 +1,65 @@
+// internal
+#include "infection_system.hpp"
+#include "world_init.hpp"
+
+#include <cmath>
+
+void InfectionSystem::init(RenderSystem* renderer_arg)
+{
+	this->renderer = renderer_arg;
+}
+
+void InfectionSystem::infect(Entity student, bool direction, float timer_ms)
+{
+	if (registry.infectTimers.has(student))
+		return;
+
+	InfectTimer& timer = registry.infectTimers.emplace(student);
+	timer.timer_ms = timer_ms;
+	timer.direction = direction;
+	pending.push({ clock_ms + timer_ms, student });
+}
+
+void InfectionSystem::step(float elapsed_ms, TEXTURE_ASSET_ID zombie_texture)
+{
+	clock_ms += elapsed_ms;
+
+	// Dying animation, the student falls over to the side it was hit from
+	const float max_angle = asin(1);
+	for (uint i = 0; i < registry.infectTimers.size(); i++)
+	{
+		Entity entity = registry.infectTimers.entities[i];
+		InfectTimer& timer = registry.infectTimers.components[i];
+		timer.timer_ms -= elapsed_ms;
+		if (!registry.motions.has(entity))
+			continue;
+		Motion& motion = registry.motions.get(entity);
+		if (timer.direction == 0 && motion.angle > -max_angle)
+			motion.angle -= max_angle / 50;
+		else if (timer.direction == 1 && motion.angle < max_angle)
+			motion.angle += max_angle / 50;
+	}
+
+	// Remove all students whose deadline passed before creating any zombies, so the
+	// removed students' sprite sheet buffers are free again for the new zombies
+	converted_positions.clear();
+	while (!pending.empty() && pending.top().deadline_ms <= clock_ms)
+	{
+		Conversion conversion = pending.top();
+		pending.pop();
+		// The student may have been removed since it was infected (e.g. it left the level)
+		if (!registry.infectTimers.has(conversion.student) || !registry.motions.has(conversion.student))
+			continue;
+		converted_positions.push_back(registry.motions.get(conversion.student).position);
+		removeEntity(conversion.student);
+	}
+
+	for (vec2 position : converted_positions)
+		createZombie(renderer, position, zombie_texture);
+}
+
+void InfectionSystem::clear()
+{
+	pending = std::priority_queue<Conversion>();
+	clock_ms = 0.f;
+}
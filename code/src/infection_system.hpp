@@ -0,0 +1,42 @@
+#pragma once
+
+#include <queue>
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs_registry.hpp"
+#include "render_system.hpp"
+
+// Turns infected students into zombies. Conversion deadlines are kept in a priority
+// queue so a frame only touches the students that are currently infected (for the
+// dying animation) and the ones whose deadline has passed, which are converted together.
+class InfectionSystem
+{
+public:
+	void init(RenderSystem* renderer);
+
+	// Infect a student, it turns into a zombie after timer_ms. Does nothing if already infected.
+	// direction is the side the student falls over to, 0 left and 1 right.
+	void infect(Entity student, bool direction, float timer_ms = 3000.f);
+
+	// Advance the infection clock and convert all students whose deadline has passed
+	void step(float elapsed_ms, TEXTURE_ASSET_ID zombie_texture);
+
+	// Drop all pending conversions, call when the level is reset
+	void clear();
+
+private:
+	struct Conversion
+	{
+		float deadline_ms;
+		Entity student;
+
+		// Min heap on the deadline
+		bool operator<(const Conversion& other) const { return deadline_ms > other.deadline_ms; }
+	};
+
+	RenderSystem* renderer = nullptr;
+	float clock_ms = 0.f;
+	std::priority_queue<Conversion> pending;
+	std::vector<vec2> converted_positions; // reused between frames
+};
@@ -3,10 +3,14 @@
 #include <gl3w.h>
 
 // stlib
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
 // internal
+#include "ai_system.hpp"
+#include "frame_profiler.hpp"
+#include "headless.hpp"
 #include "physics_system.hpp"
 #include "render_system.hpp"
 #include "world_system.hpp"
@@ -15,32 +19,127 @@
 
 using Clock = std::chrono::high_resolution_clock;
 
+// Frames recorded per agent count in the stress test
+const int STRESS_FRAMES_PER_RUN = 600;
+
+// Headless benchmark: recorded frames by default, fixed time step and random seed so that
+// two runs of the same level draw the same frames
+const int HEADLESS_DEFAULT_FRAMES = 300;
+const float HEADLESS_FRAME_MS = 1000.f / 60.f;
+const unsigned int HEADLESS_SEED = 1234;
+// A golden comparison fails if more than this fraction of pixels differ by more than the tolerance
+const int HEADLESS_GOLDEN_TOLERANCE = 8;
+const float HEADLESS_GOLDEN_MAX_DIFF = 0.001f;
+
 // Entry point
-int main()
+// --stress N          play with N zombies and N students per level and report per-system frame times
+// --stress-sweep      the same for 10, 100, 1000 and 10000 agents, one run after the other
+// --level L           level to run the stress test in (curr_level value, defaults to the save)
+// --headless          render the level in an invisible window with a fixed time step and seed,
+//                     report frame times and draw calls, then exit
+// --frames N          frames recorded by the headless run
+// --capture FILE      write the last headless frame to FILE (TGA)
+// --golden FILE       compare the last headless frame with FILE, exits with failure on mismatch
+// --texture-budget MB level textures kept loaded after their level ends
+// --render-scale S    draw at S (0.5 to 1) times the window's resolution instead of picking it
+//                     from the GPU frame time
+// --gpu-target-ms MS  GPU frame time the resolution is adjusted towards
+int main(int argc, char* argv[])
 {
+	auto startup_time = Clock::now();
+	std::vector<int> stress_counts;
+	int stress_level = -1;
+	bool headless = false;
+	int headless_frames = HEADLESS_DEFAULT_FRAMES;
+	std::string capture_path;
+	std::string golden_path;
+	int texture_budget_mb = -1;
+	float render_scale = 0.f;
+	float gpu_target_ms = 0.f;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--stress" && i + 1 < argc) {
+			stress_counts = { atoi(argv[++i]) };
+		}
+		else if (arg == "--stress-sweep") {
+			stress_counts = { 10, 100, 1000, 10000 };
+		}
+		else if (arg == "--level" && i + 1 < argc) {
+			stress_level = atoi(argv[++i]);
+		}
+		else if (arg == "--headless") {
+			headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			headless_frames = atoi(argv[++i]);
+		}
+		else if (arg == "--capture" && i + 1 < argc) {
+			capture_path = argv[++i];
+		}
+		else if (arg == "--golden" && i + 1 < argc) {
+			golden_path = argv[++i];
+		}
+		else if (arg == "--texture-budget" && i + 1 < argc) {
+			texture_budget_mb = atoi(argv[++i]);
+		}
+		else if (arg == "--render-scale" && i + 1 < argc) {
+			render_scale = std::min(std::max((float)atof(argv[++i]), MIN_RENDER_SCALE), 1.f);
+		}
+		else if (arg == "--gpu-target-ms" && i + 1 < argc) {
+			gpu_target_ms = (float)atof(argv[++i]);
+		}
+	}
+	size_t stress_run = 0;
+	const int frames_per_run = headless ? headless_frames : STRESS_FRAMES_PER_RUN;
+	int exit_code = EXIT_SUCCESS;
+	FrameProfiler profiler;
+
 	// Global systems
 	WorldSystem world_system;
 	RenderSystem render_system;
 	PhysicsSystem physics_system;
+	AISystem ai_system;
 
 	// Initializing window
-	GLFWwindow* window = world_system.create_window();
+	GLFWwindow* window = world_system.create_window(!headless);
 	if (!window) {
+		if (headless)
+			return EXIT_FAILURE;
 		// Time to read the error message
 		printf("Press any key to exit");
 		getchar();
 		return EXIT_FAILURE;
 	}
+	if (headless) {
+		world_system.setRandomSeed(HEADLESS_SEED);
+	}
 
 	// initialize the main systems
 	render_system.init(window);
+	if (texture_budget_mb >= 0) {
+		render_system.setTextureBudget((size_t)texture_budget_mb * 1024 * 1024);
+	}
+	if (headless) {
+		// Measure the frames, not the display's refresh rate
+		glfwSwapInterval(0);
+	}
+	if (!capture_path.empty() || !golden_path.empty()) {
+		render_system.setFrameCapture(true);
+	}
+	render_system.setRenderScale(render_scale);
+	if (gpu_target_ms > 0.f) {
+		render_system.setGpuFrameTarget(gpu_target_ms);
+	}
     world_system.init(&render_system);
+    ai_system.init(&render_system);
     world_system.loadFromSave();
 	debugging.in_full_view_mode = true;
 	Entity loadingScreen;
     Entity ubzTitle;
     Entity playButton;
     Entity lab_level;
+    Entity loading_bar;
+    Entity loading_bar_fill;
     Entity busloop_level;
     Entity sewer_level;
     Entity wreck_level;
@@ -55,6 +154,22 @@ int main()
     bool firstLoad = true;
     int levelSelected = 0;
     bool isLevelSelected = true;
+    bool menuShown = false;
+
+	// The stress test and the headless benchmark skip the menu and go straight into the level
+	if (!stress_counts.empty() || headless) {
+		if (stress_level >= 0) {
+			world_system.curr_level = stress_level;
+		}
+		if (!stress_counts.empty()) {
+			world_system.setStressAgents(stress_counts[0]);
+		}
+		world_system.game_state = PLAYING;
+		world_system.prev_state = PLAYING;
+		debugging.in_full_view_mode = false;
+		world_system.initGameState();
+		profiler.beginRun((int)registry.zombies.size(), (int)registry.humans.size() - 1, frames_per_run);
+	}
 
 	auto t = Clock::now();
 	float total_elapsed = 0.f;
@@ -65,7 +180,7 @@ int main()
             world_system.transitionToMenuState();
             world_system.menu_click_pos = {0, 0};
 
-            loadingScreen = createOverlay(&render_system, { window_width_px / 2, window_height_px / 2 }, { 1440, 810 }, TEXTURE_ASSET_ID::LOADING_SCREEN, false);
+            loadingScreen = createOverlay(&render_system, { window_width_px / 2, window_height_px / 2 }, { 1440, 810 }, TEXTURE_ASSET_ID::LOADING_SCREEN, false, RENDER_LAYER::OVERLAY_BACKGROUND);
             ubzTitle = createOverlay(&render_system, { window_width_px / 2, window_height_px / 2  - 200}, { 600, 600 }, TEXTURE_ASSET_ID::UBZ_TITLE, false);
             playButton = createOverlay(&render_system, { window_width_px / 2, 350 }, { 160, 80 }, TEXTURE_ASSET_ID::PLAY_BUTTON, false);
 
@@ -90,6 +205,13 @@ int main()
             menu_entities.push_back(sewer_level);
             menu_entities.push_back(forest_level);
             menu_entities.push_back(lab_level);
+
+            // Textures keep streaming in while the menu is up
+            if (!render_system.texturesLoaded()) {
+                loading_bar_fill = createOverlay(&render_system, { window_width_px / 2, 780 }, { 400, 20 }, TEXTURE_ASSET_ID::HP, false);
+                loading_bar = createOverlay(&render_system, { window_width_px / 2, 780 }, { 400, 20 }, TEXTURE_ASSET_ID::HP_BAR, false);
+                registry.renderRequests.get(loading_bar).order = 1;
+            }
         }
 
         // ------------------------ GAME STATE MENU ------------------------
@@ -215,8 +337,26 @@ int main()
                 break;
             }
 
+            if (registry.motions.has(loading_bar_fill)) {
+                float progress = render_system.getTextureLoadProgress();
+                Motion& fill_motion = registry.motions.get(loading_bar_fill);
+                fill_motion.scale.x = progress * 400;
+                fill_motion.position.x = window_width_px / 2 - (1 - progress) * 400 / 2;
+                if (render_system.texturesLoaded()) {
+                    registry.remove_all_components_of(loading_bar_fill);
+                    registry.remove_all_components_of(loading_bar);
+                    printf("Startup textures loaded after %.1f ms, %d of %d from the cooked cache\n",
+                        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startup_time).count() / 1000.f,
+                        render_system.getCookedTextureCount(), render_system.getLoadedTextureCount());
+                }
+            }
+
             render_system.drawMenu(0);
             glfwPollEvents();
+            if (!menuShown) {
+                menuShown = true;
+                printf("Menu shown after %.1f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startup_time).count() / 1000.f);
+            }
         }
 
         if (world_system.prev_state == MENU) {
@@ -233,6 +373,11 @@ int main()
             if (isLevelSelected) {
                 world_system.curr_level = levelSelected;
             }
+            // restart_level waits for the level's textures
+            if (registry.motions.has(loading_bar_fill)) {
+                registry.remove_all_components_of(loading_bar_fill);
+                registry.remove_all_components_of(loading_bar);
+            }
             world_system.initGameState();
             if (!firstLoad) {
                 world_system.pause_end = Clock::now();
@@ -257,16 +402,65 @@ int main()
             auto now = Clock::now();
             float elapsed_ms =
                 ((float)(std::chrono::duration_cast<std::chrono::microseconds>(now - t)).count() / 1000) - world_system.pause_duration;
+            if (headless) {
+                elapsed_ms = HEADLESS_FRAME_MS;
+            }
             total_elapsed += elapsed_ms;
             t = now;
             world_system.pause_duration = 0.f;
 
+            profiler.begin(FrameProfiler::WORLD);
             world_system.step(elapsed_ms);
+            profiler.end(FrameProfiler::WORLD);
+            profiler.begin(FrameProfiler::AI);
+            ai_system.step(elapsed_ms);
+            profiler.end(FrameProfiler::AI);
+            profiler.begin(FrameProfiler::PHYSICS);
             physics_system.step(elapsed_ms);
-            render_system.step(elapsed_ms);
+            profiler.end(FrameProfiler::PHYSICS);
+            profiler.begin(FrameProfiler::WORLD);
             world_system.handle_collisions();
+            profiler.end(FrameProfiler::WORLD);
 
+            profiler.begin(FrameProfiler::RENDER);
+            render_system.step(elapsed_ms);
             render_system.draw(elapsed_ms);
+            profiler.end(FrameProfiler::RENDER);
+            const RenderStats& render_stats = render_system.getStats();
+            profiler.setRenderCounters(render_stats.draw_calls, render_stats.gl_state_queries, render_stats.visible_sprites, render_stats.total_sprites);
+
+            // Move on to the next agent count once the current one has been recorded
+            if (profiler.endFrame()) {
+                if (++stress_run < stress_counts.size()) {
+                    world_system.setStressAgents(stress_counts[stress_run]);
+                    world_system.initGameState();
+                    profiler.beginRun((int)registry.zombies.size(), (int)registry.humans.size() - 1, frames_per_run);
+                }
+                else if (headless) {
+                    profiler.report(data_path() + "/headless_results.csv");
+                    printf("Render scale %.2f, GPU frame %.2f ms\n", render_stats.render_scale, render_stats.gpu_frame_ms);
+                    if (!capture_path.empty() || !golden_path.empty()) {
+                        std::vector<uint8_t> frame;
+                        render_system.readFrame(frame);
+                        ivec2 frame_size = { window_width_px, window_height_px };
+                        if (!capture_path.empty() && writeFrameTGA(capture_path, frame, frame_size)) {
+                            printf("Wrote frame capture to %s\n", capture_path.c_str());
+                        }
+                        if (!golden_path.empty()) {
+                            float diff = compareWithGolden(golden_path, frame, frame_size, HEADLESS_GOLDEN_TOLERANCE);
+                            bool match = diff >= 0.f && diff <= HEADLESS_GOLDEN_MAX_DIFF;
+                            printf("Golden %s: %s (%.4f%% of pixels differ)\n", golden_path.c_str(), match ? "match" : "MISMATCH", diff * 100.f);
+                            if (!match)
+                                exit_code = EXIT_FAILURE;
+                        }
+                    }
+                    glfwSetWindowShouldClose(window, GLFW_TRUE);
+                }
+                else {
+                    profiler.report(data_path() + "/stress_results.csv");
+                    glfwSetWindowShouldClose(window, GLFW_TRUE);
+                }
+            }
         }
 
         // ------------------------ GAME STATE PAUSE ------------------------
@@ -355,5 +549,5 @@ int main()
         }
     }
 
-	return EXIT_SUCCESS;
+	return exit_code;
 }
@@ -0,0 +1,30 @@
+#pragma once
+
+// stlib
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read only into memory, unmapped on destruction
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Returns false if the file doesn't exist or can't be mapped
+	bool open(const std::string& path);
+	void close();
+
+	const unsigned char* getData() const { return data; }
+	size_t getSize() const { return size; }
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+};
@@ -0,0 +1,321 @@
+// internal
+#include "raycast.hpp"
+#include "tiny_ecs_registry.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <glm/common.hpp>    // min, max
+#include <glm/geometric.hpp> // length, normalize
+
+namespace
+{
+	// Moving platforms are re-bucketed every frame with the dynamic entities
+	bool isMoving(Entity entity)
+	{
+		return registry.motions.get(entity).velocity != vec2(0.f, 0.f) || registry.keyframeAnimations.has(entity);
+	}
+
+	// Slab test of a ray against a box. Boxes containing the origin are not reported
+	// so a ray cast from inside an entity doesn't hit that entity.
+	bool intersectBox(vec2 origin, vec2 inv_direction, vec2 lo, vec2 hi, float& t, vec2& normal)
+	{
+		float t_near = -std::numeric_limits<float>::infinity();
+		float t_far = std::numeric_limits<float>::infinity();
+		vec2 near_normal = { 0.f, 0.f };
+		for (int axis = 0; axis < 2; axis++)
+		{
+			if (std::isinf(inv_direction[axis]))
+			{
+				// Ray parallel to this slab
+				if (origin[axis] < lo[axis] || origin[axis] > hi[axis])
+					return false;
+				continue;
+			}
+			float t0 = (lo[axis] - origin[axis]) * inv_direction[axis];
+			float t1 = (hi[axis] - origin[axis]) * inv_direction[axis];
+			float side = -1.f;
+			if (t0 > t1)
+			{
+				std::swap(t0, t1);
+				side = 1.f;
+			}
+			if (t0 > t_near)
+			{
+				t_near = t0;
+				near_normal = { 0.f, 0.f };
+				near_normal[axis] = side;
+			}
+			t_far = std::min(t_far, t1);
+		}
+		if (t_near > t_far || t_near < 0.f)
+			return false;
+		t = t_near;
+		normal = near_normal;
+		return true;
+	}
+}
+
+BoxGrid::BoxGrid(float cell_size)
+	: min_cell_size(cell_size), cell_size(cell_size)
+{
+	assert(cell_size > 0.f);
+}
+
+void BoxGrid::add(Entity entity, vec2 top_left, vec2 bottom_right)
+{
+	boxes.push_back({ entity, (unsigned int)entity, min(top_left, bottom_right), max(top_left, bottom_right) });
+}
+
+void BoxGrid::clear()
+{
+	boxes.clear();
+	cell_boxes.clear();
+	cell_start.clear();
+	columns = 0;
+	rows = 0;
+}
+
+ivec2 BoxGrid::cellCoord(vec2 position) const
+{
+	int x = (int)std::floor((position.x - origin.x) / cell_size);
+	int y = (int)std::floor((position.y - origin.y) / cell_size);
+	x = std::min(std::max(x, 0), columns - 1);
+	y = std::min(std::max(y, 0), rows - 1);
+	return { x, y };
+}
+
+void BoxGrid::build()
+{
+	cell_boxes.clear();
+	if (boxes.empty())
+	{
+		clear();
+		return;
+	}
+
+	vec2 lo = boxes[0].lo;
+	vec2 hi = boxes[0].hi;
+	for (const Box& box : boxes)
+	{
+		lo = min(lo, box.lo);
+		hi = max(hi, box.hi);
+	}
+	origin = lo;
+	vec2 extent = hi - lo;
+	cell_size = std::max(min_cell_size, std::max(extent.x, extent.y) / MAX_CELLS_PER_AXIS);
+	columns = (int)(extent.x / cell_size) + 1;
+	rows = (int)(extent.y / cell_size) + 1;
+
+	// Counting sort of the box references by cell: count, prefix sum, scatter
+	cell_start.assign(columns * rows + 1, 0);
+	for (const Box& box : boxes)
+	{
+		ivec2 c0 = cellCoord(box.lo);
+		ivec2 c1 = cellCoord(box.hi);
+		for (int cy = c0.y; cy <= c1.y; cy++)
+			for (int cx = c0.x; cx <= c1.x; cx++)
+				cell_start[cy * columns + cx + 1]++;
+	}
+	for (size_t c = 1; c < cell_start.size(); c++)
+		cell_start[c] += cell_start[c - 1];
+
+	cell_boxes.resize(cell_start.back());
+	std::vector<int> cursor(cell_start.begin(), cell_start.end() - 1);
+	for (int i = 0; i < (int)boxes.size(); i++)
+	{
+		ivec2 c0 = cellCoord(boxes[i].lo);
+		ivec2 c1 = cellCoord(boxes[i].hi);
+		for (int cy = c0.y; cy <= c1.y; cy++)
+			for (int cx = c0.x; cx <= c1.x; cx++)
+				cell_boxes[cursor[cy * columns + cx]++] = i;
+	}
+}
+
+void BoxGrid::query(vec2 top_left, vec2 bottom_right, std::vector<Entity>& entities) const
+{
+	if (boxes.empty())
+		return;
+	vec2 lo = min(top_left, bottom_right);
+	vec2 hi = max(top_left, bottom_right);
+	vec2 grid_hi = origin + vec2(columns, rows) * cell_size;
+	if (hi.x < origin.x || hi.y < origin.y || lo.x > grid_hi.x || lo.y > grid_hi.y)
+		return;
+
+	ivec2 c0 = cellCoord(lo);
+	ivec2 c1 = cellCoord(hi);
+	for (int cy = c0.y; cy <= c1.y; cy++)
+	{
+		for (int cx = c0.x; cx <= c1.x; cx++)
+		{
+			int c = cy * columns + cx;
+			for (int i = cell_start[c]; i < cell_start[c + 1]; i++)
+			{
+				const Box& box = boxes[cell_boxes[i]];
+				if (box.hi.x < lo.x || box.hi.y < lo.y || box.lo.x > hi.x || box.lo.y > hi.y)
+					continue;
+				// A box spanning several cells is only reported from the first one
+				// the query visits
+				ivec2 first = max(cellCoord(box.lo), c0);
+				if (first.x == cx && first.y == cy)
+					entities.push_back(box.entity);
+			}
+		}
+	}
+}
+
+bool BoxGrid::raycast(vec2 ray_origin, vec2 direction, float max_distance, RayHit& hit, int ignore) const
+{
+	if (boxes.empty() || max_distance <= 0.f)
+		return false;
+	float len = length(direction);
+	if (len == 0.f)
+		return false;
+	vec2 dir = direction / len;
+	vec2 inv_dir = { 1.f / dir.x, 1.f / dir.y };
+
+	// Clip the ray against the grid bounds
+	vec2 grid_hi = origin + vec2(columns, rows) * cell_size;
+	float t_enter;
+	vec2 unused_normal;
+	bool inside = ray_origin.x >= origin.x && ray_origin.x <= grid_hi.x && ray_origin.y >= origin.y && ray_origin.y <= grid_hi.y;
+	if (inside)
+		t_enter = 0.f;
+	else if (!intersectBox(ray_origin, inv_dir, origin, grid_hi, t_enter, unused_normal))
+		return false;
+	if (t_enter > max_distance)
+		return false;
+
+	ivec2 cell = cellCoord(ray_origin + dir * t_enter);
+	ivec2 step = { dir.x > 0.f ? 1 : -1, dir.y > 0.f ? 1 : -1 };
+	vec2 t_delta = { std::abs(cell_size * inv_dir.x), std::abs(cell_size * inv_dir.y) };
+	vec2 t_max;
+	for (int axis = 0; axis < 2; axis++)
+	{
+		if (dir[axis] == 0.f)
+		{
+			t_max[axis] = std::numeric_limits<float>::infinity();
+			continue;
+		}
+		float boundary = origin[axis] + (cell[axis] + (step[axis] > 0 ? 1 : 0)) * cell_size;
+		t_max[axis] = (boundary - ray_origin[axis]) * inv_dir[axis];
+	}
+
+	float best_t = max_distance;
+	bool found = false;
+	while (true)
+	{
+		int c = cell.y * columns + cell.x;
+		for (int i = cell_start[c]; i < cell_start[c + 1]; i++)
+		{
+			const Box& box = boxes[cell_boxes[i]];
+			if (ignore >= 0 && box.id == (unsigned int)ignore)
+				continue;
+			float t;
+			vec2 normal;
+			if (intersectBox(ray_origin, inv_dir, box.lo, box.hi, t, normal) && t <= best_t)
+			{
+				best_t = t;
+				hit.entity = box.entity;
+				hit.normal = normal;
+				found = true;
+			}
+		}
+
+		// Nothing in a later cell can be closer than a hit before this cell's exit
+		float t_exit = std::min(t_max.x, t_max.y);
+		if ((found && best_t <= t_exit) || t_exit > max_distance)
+			break;
+
+		if (t_max.x < t_max.y)
+		{
+			cell.x += step.x;
+			t_max.x += t_delta.x;
+		}
+		else
+		{
+			cell.y += step.y;
+			t_max.y += t_delta.y;
+		}
+		if (cell.x < 0 || cell.x >= columns || cell.y < 0 || cell.y >= rows)
+			break;
+	}
+
+	if (found)
+	{
+		hit.t = best_t;
+		hit.point = ray_origin + dir * best_t;
+	}
+	return found;
+}
+
+void RaycastSystem::buildStatic()
+{
+	static_grid.clear();
+	auto addStatic = [&](Entity entity) {
+		if (!registry.motions.has(entity))
+			return;
+		if (isMoving(entity))
+			return;
+		Motion& motion = registry.motions.get(entity);
+		vec2 half = abs(motion.scale) / 2.f;
+		static_grid.add(entity, motion.position - half, motion.position + half);
+	};
+	for (Entity entity : registry.platforms.entities)
+		addStatic(entity);
+	for (Entity entity : registry.walls.entities)
+		addStatic(entity);
+	static_grid.build();
+}
+
+void RaycastSystem::buildDynamic() const
+{
+	dynamic_grid.clear();
+	auto addDynamic = [&](Entity entity) {
+		if (!registry.motions.has(entity))
+			return;
+		Motion& motion = registry.motions.get(entity);
+		vec2 half = abs(motion.scale) / 2.f;
+		dynamic_grid.add(entity, motion.position - half, motion.position + half);
+	};
+	for (Entity entity : registry.humans.entities)
+		addDynamic(entity);
+	for (Entity entity : registry.zombies.entities)
+		addDynamic(entity);
+	for (Entity entity : registry.platforms.entities)
+	{
+		if (registry.motions.has(entity) && isMoving(entity))
+			addDynamic(entity);
+	}
+	dynamic_grid.build();
+	dynamic_valid = true;
+}
+
+void RaycastSystem::clear()
+{
+	static_grid.clear();
+	dynamic_grid.clear();
+	dynamic_valid = false;
+}
+
+bool RaycastSystem::raycast(vec2 origin, vec2 direction, float max_distance, RayHit& hit, int mask, int ignore) const
+{
+	bool hit_static = (mask & RAYCAST_STATIC) && static_grid.raycast(origin, direction, max_distance, hit, ignore);
+	// The dynamic query only has to look as far as the static hit, anything it finds overwrites it
+	float dynamic_distance = hit_static ? hit.t : max_distance;
+	if ((mask & RAYCAST_DYNAMIC) && !dynamic_valid)
+		buildDynamic();
+	bool hit_dynamic = (mask & RAYCAST_DYNAMIC) && dynamic_grid.raycast(origin, direction, dynamic_distance, hit, ignore);
+	return hit_static || hit_dynamic;
+}
+
+bool RaycastSystem::segmentQuery(vec2 from, vec2 to, RayHit& hit, int mask, int ignore) const
+{
+	return raycast(from, to - from, length(to - from), hit, mask, ignore);
+}
+
+bool RaycastSystem::lineOfSight(vec2 from, vec2 to) const
+{
+	return !segmentQuery(from, to, scratch_hit, RAYCAST_STATIC);
+}
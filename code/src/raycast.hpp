@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+
+// Result of a ray or segment query. Keep one around instead of creating one per query,
+// the Entity member allocates a new id when default constructed.
+struct RayHit
+{
+	Entity entity;
+	vec2 point = { 0.f, 0.f };
+	vec2 normal = { 0.f, 0.f }; // axis aligned, points out of the hit box
+	float t = 0.f;              // distance along the ray from the origin
+};
+
+// Axis aligned boxes bucketed into a uniform grid. Rays walk the grid cell by cell
+// (Amanatides & Woo DDA) so a query only tests the boxes along its path and can stop
+// as soon as the closest hit so far lies before the next cell.
+class BoxGrid
+{
+public:
+	BoxGrid(float cell_size = 64.f);
+
+	// Queue a box for the next build()
+	void add(Entity entity, vec2 top_left, vec2 bottom_right);
+	// Buckets all added boxes into their cells, call after all add()s
+	void build();
+	void clear();
+
+	// First box hit by the ray within max_distance, skipping ignore (pass -1 to not skip)
+	bool raycast(vec2 origin, vec2 direction, float max_distance, RayHit& hit, int ignore = -1) const;
+	// Appends every box overlapping the rectangle to entities, each box once
+	void query(vec2 top_left, vec2 bottom_right, std::vector<Entity>& entities) const;
+
+	size_t size() const { return boxes.size(); }
+
+private:
+	struct Box
+	{
+		Entity entity;
+		unsigned int id;
+		vec2 lo;
+		vec2 hi;
+	};
+
+	// Upper bound on columns/rows, cells grow instead for very large levels
+	static const int MAX_CELLS_PER_AXIS = 256;
+
+	ivec2 cellCoord(vec2 position) const;
+
+	float min_cell_size;
+	float cell_size;
+	vec2 origin = { 0.f, 0.f };
+	int columns = 0;
+	int rows = 0;
+
+	std::vector<Box> boxes;
+	std::vector<int> cell_boxes; // box indices sorted by cell, a box spanning several cells is in each
+	std::vector<int> cell_start; // prefix sums, size columns * rows + 1
+};
+
+enum RAYCAST_MASK
+{
+	RAYCAST_STATIC = 1,  // platforms and walls that don't move
+	RAYCAST_DYNAMIC = 2, // humans, zombies and moving platforms
+	RAYCAST_ALL = RAYCAST_STATIC | RAYCAST_DYNAMIC
+};
+
+// Ray and segment queries against the level. The static geometry is bucketed once when
+// the level is loaded, the dynamic entities by the first query of a frame that needs them.
+class RaycastSystem
+{
+public:
+	// Call once the level's platforms and walls have been created
+	void buildStatic();
+	// Call once per frame after entities have moved, the dynamic grid is rebuilt on demand
+	void invalidateDynamic() { dynamic_valid = false; }
+	void clear();
+
+	// First hit along the ray within max_distance, hit is only written when something is hit
+	bool raycast(vec2 origin, vec2 direction, float max_distance, RayHit& hit, int mask = RAYCAST_ALL, int ignore = -1) const;
+	// First hit between from and to
+	bool segmentQuery(vec2 from, vec2 to, RayHit& hit, int mask = RAYCAST_ALL, int ignore = -1) const;
+	// True if no static geometry blocks the segment between from and to
+	bool lineOfSight(vec2 from, vec2 to) const;
+
+private:
+	void buildDynamic() const;
+
+	BoxGrid static_grid;
+	mutable BoxGrid dynamic_grid;
+	mutable bool dynamic_valid = false;
+	mutable RayHit scratch_hit; // for queries that only need a yes/no answer
+};
@@ -0,0 +1,54 @@
+// internal
+#include "render_queue.hpp"
+
+#include <array>
+
+// Bit layout of the sort key, the lowest 8 bits are unused
+const int KEY_LAYER_SHIFT = 56;    // 8 bits
+const int KEY_ORDER_SHIFT = 40;    // 16 bits
+const int KEY_EFFECT_SHIFT = 32;   // 8 bits
+const int KEY_TEXTURE_SHIFT = 16;  // 16 bits, the GL texture so atlas pages group together
+const int KEY_GEOMETRY_SHIFT = 8;  // 8 bits
+
+uint64_t RenderQueue::makeKey(const RenderRequest& render_request, GLuint texture)
+{
+	return ((uint64_t)render_request.layer << KEY_LAYER_SHIFT) |
+		((uint64_t)render_request.order << KEY_ORDER_SHIFT) |
+		((uint64_t)((uint)render_request.used_effect & 0xff) << KEY_EFFECT_SHIFT) |
+		((uint64_t)(texture & 0xffff) << KEY_TEXTURE_SHIFT) |
+		((uint64_t)((uint)render_request.used_geometry & 0xff) << KEY_GEOMETRY_SHIFT);
+}
+
+void RenderQueue::sort()
+{
+	if (items.size() < 2)
+		return;
+
+	// Bytes that are the same in every key don't need a pass
+	uint64_t all_and = ~(uint64_t)0;
+	uint64_t all_or = 0;
+	for (const Item& item : items)
+	{
+		all_and &= item.key;
+		all_or |= item.key;
+	}
+	const uint64_t differing = all_and ^ all_or;
+
+	scratch.resize(items.size(), items[0]);
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		if (((differing >> shift) & 0xff) == 0)
+			continue;
+
+		// Counting sort by this byte, stable so the previous passes (and the creation
+		// order of requests with equal keys) are kept
+		std::array<uint, 257> offsets = {};
+		for (const Item& item : items)
+			offsets[((item.key >> shift) & 0xff) + 1]++;
+		for (uint i = 1; i < offsets.size(); i++)
+			offsets[i] += offsets[i - 1];
+		for (const Item& item : items)
+			scratch[offsets[(item.key >> shift) & 0xff]++] = item;
+		items.swap(scratch);
+	}
+}
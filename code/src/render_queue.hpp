@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "components.hpp"
+
+// The frame's draw list. Every render request gets a 64 bit sort key, most significant
+// first: layer, order within the layer, effect, texture and geometry. Sorting by the key
+// draws the layers back to front and groups requests with the same GPU state, so layering
+// doesn't depend on the order entities were created in. Requests that can overlap each
+// other need different orders, within the same order the texture decides which is on top.
+// The sort is a stable LSD radix sort that skips the bytes all keys share.
+class RenderQueue
+{
+public:
+	struct Item
+	{
+		uint64_t key;
+		uint render_index; // index into registry.renderRequests
+		int baked_run;     // index into the renderer's baked static runs instead, -1 if not
+	};
+
+	static uint64_t makeKey(const RenderRequest& render_request, GLuint texture);
+
+	void clear() { items.clear(); }
+	void push(uint64_t key, uint render_index) { items.push_back({ key, render_index, -1 }); }
+	void pushBaked(uint64_t key, int baked_run) { items.push_back({ key, 0, baked_run }); }
+	void sort();
+
+	const std::vector<Item>& getItems() const { return items; }
+
+private:
+	std::vector<Item> items;
+	std::vector<Item> scratch;
+};
@@ -1,6 +1,11 @@
 // internal
 #include "render_system.hpp"
 #include <SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <glm/matrix.hpp> // inverse
 #include <iostream>
 
 #include "tiny_ecs_registry.hpp"
@@ -8,8 +13,6 @@
 float screen_width = screen_width_px;
 float screen_height = screen_width_px;
 
-int bufferIds[50];
-
 float previousLeft = 0.f;
 float currentLeft = 0.f;
 
@@ -34,6 +37,8 @@ void RenderSystem::drawTexturedMesh(Entity entity,
 	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
 	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
 	const GLuint program = (GLuint)effects[used_effect_enum];
+	const EFFECT_ASSET_ID effect = render_request.used_effect;
+	const EffectLocations& locations = effect_locations[used_effect_enum];
 
 	// Setting shaders
 	glUseProgram(program);
@@ -41,238 +46,653 @@ void RenderSystem::drawTexturedMesh(Entity entity,
 
 	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
 
-	GLuint vbo;
-	GLuint ibo;
-	if (render_request.used_geometry == GEOMETRY_BUFFER_ID::SPRITE_SHEET)
+	// The vertex array object holds the buffers and vertex format of the geometry, sprite
+	// sheets share the sprite quad and select their frame with the uv_rect uniform
+	const GLuint geometry = render_request.used_geometry == GEOMETRY_BUFFER_ID::SPRITE_SHEET ?
+		(GLuint)GEOMETRY_BUFFER_ID::SPRITE : (GLuint)render_request.used_geometry;
+	glBindVertexArray(vertex_arrays[geometry]);
+	gl_has_errors();
+
+	if (effect == EFFECT_ASSET_ID::TEXTURED || effect == EFFECT_ASSET_ID::BLENDED || effect == EFFECT_ASSET_ID::OVERLAY_TEXTURED)
+	{
+		// Enabling and binding texture to slot 0
+		glActiveTexture(GL_TEXTURE0);
+		gl_has_errors();
+
+		bindSpriteTexture(render_request.used_texture);
+		gl_has_errors();
+
+		setUniform4fv(effect, UNIFORM_ID::UV_RECT, getUVRect(entity, render_request));
+
+		if (effect == EFFECT_ASSET_ID::OVERLAY_TEXTURED)
+		{
+			// Fading
+			float fading_factor = registry.fading.has(entity) ? registry.fading.get(entity).fading_factor : 0.f;
+			setUniform1f(effect, UNIFORM_ID::FADING_FACTOR, fading_factor);
+		}
+		//glEnable(GL_BLEND);
+		//glBlendFunc(GL_ONE, GL_ONE);
+	}
+
+	// FUTURE: won't need for now, could reuse if we end up having meshes
+	else if (effect == EFFECT_ASSET_ID::SPIKE || effect == EFFECT_ASSET_ID::WHEEL)
 	{
-		assert(registry.spriteSheets.has(entity));
-		const SpriteSheet& spriteSheet = registry.spriteSheets.get(entity);
-		vbo = spriteSheet.bufferId + 1;
-		ibo = vertex_buffers.size() + vbo;
+		if (effect == EFFECT_ASSET_ID::WHEEL)
+		{
+			// Define colors for the wheel and spikes
+			vec3 wheelColor = vec3(0.5f, 0.35f, 0.05); // Brown color for the wheel
+			vec3 spikeColor = vec3(0.628, 0.095, 0.990); // Purple color for the spikes
+
+			// Set the uniform values for the colors
+			setUniform3fv(effect, UNIFORM_ID::WHEEL_COLOR, (float*)&wheelColor, 1);
+			setUniform3fv(effect, UNIFORM_ID::SPIKE_COLOR, (float*)&spikeColor, 1);
+			gl_has_errors();
+		}
+		else
+		{
+			// Light up?
+			assert(locations.uniforms[(int)UNIFORM_ID::LIGHT_UP] >= 0);
+
+			// !!! TODO A1: set the light_up shader variable using glUniform1i,
+			// similar to the glUniform1f call below. The 1f or 1i specified the type, here a single int.
+		}
+
 	}
 	else
 	{
-		vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-		ibo = index_buffers[(GLuint)render_request.used_geometry];
+		assert(false && "Type of render request not supported");
 	}
 
+	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
+	setUniform3fv(effect, UNIFORM_ID::FCOLOR, (float*)&color, 1);
+	gl_has_errors();
+
+	// Index count recorded when the buffers were uploaded
+	const GeometryInfo& geometry_info = geometry_infos[geometry];
+	assert(geometry_info.index_count > 0);
 
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	// Setting uniform values to the currently bound program
+	setUniformMatrix3fv(effect, UNIFORM_ID::TRANSFORM, transform.mat);
+	setUniformMatrix3fv(effect, UNIFORM_ID::PROJECTION, projection);
+	setUniformMatrix3fv(effect, UNIFORM_ID::LIGHT_PROJECTION, light_projection);
+	gl_has_errors();
+	// Drawing of index_count/3 triangles specified in the index buffer
+	glDrawElements(GL_TRIANGLES, geometry_info.index_count, geometry_info.index_type, nullptr);
 	gl_has_errors();
+	stats.draw_calls++;
+}
 
-	// Input data location as in the vertex buffer
-	if (render_request.used_effect == EFFECT_ASSET_ID::TEXTURED)
+void RenderSystem::bindSpriteTexture(TEXTURE_ASSET_ID texture)
+{
+	glBindTexture(GL_TEXTURE_2D, texture_gl_handles[(GLuint)texture]);
+	const GLuint sampler = texture_in_atlas[(GLuint)texture] ? atlas_sampler : sprite_sampler;
+	if (sampler != bound_sprite_sampler)
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
+		glBindSampler(SPRITE_TEXTURE_UNIT, sampler);
+		bound_sprite_sampler = sampler;
+	}
+}
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(TexturedVertex), (void*)0);
-		gl_has_errors();
+void RenderSystem::beginFrameStats()
+{
+	stats = RenderStats();
+	frame_state_query_start = gl_state_query_count;
+	frame_error_query_start = gl_error_query_count;
+}
 
-		glEnableVertexAttribArray(in_texcoord_loc);
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-			(void*)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
+void RenderSystem::endFrameStats()
+{
+	stats.gl_state_queries = (int)(gl_state_query_count - frame_state_query_start);
+	stats.gl_error_queries = (int)(gl_error_query_count - frame_error_query_start);
+}
 
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
-		gl_has_errors();
+bool RenderSystem::updateUniformCache(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const void* data, size_t bytes)
+{
+	std::vector<uint8_t>& cached = uniform_cache[(int)effect][(int)uniform];
+	if (cached.size() == bytes && memcmp(cached.data(), data, bytes) == 0)
+	{
+		stats.uniform_uploads_skipped++;
+		return false;
+	}
+	cached.assign((const uint8_t*)data, (const uint8_t*)data + bytes);
+	stats.uniform_uploads++;
+	return true;
+}
 
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id = texture_gl_handles[(GLuint)render_request.used_texture];
+void RenderSystem::setUniform1i(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, int value)
+{
+	GLint location = effect_locations[(int)effect].uniforms[(int)uniform];
+	if (location >= 0 && updateUniformCache(effect, uniform, &value, sizeof(value)))
+		glUniform1i(location, value);
+}
 
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
+void RenderSystem::setUniform1f(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, float value)
+{
+	GLint location = effect_locations[(int)effect].uniforms[(int)uniform];
+	if (location >= 0 && updateUniformCache(effect, uniform, &value, sizeof(value)))
+		glUniform1f(location, value);
+}
 
-		// Lighting
-		GLuint hasLights_loc = glGetUniformLocation(program, "hasLights");
-		GLuint lights_loc = glGetUniformLocation(program, "lights");
-		if (registry.lights.size() > 0) 
-		{
-			glUniform1f(hasLights_loc, true);
-			glUniform3fv(lights_loc, registry.lights.components.size(), reinterpret_cast<GLfloat*>(&registry.lights.components[0]));
-		}
-		else 
-		{
-			glUniform1f(hasLights_loc, false);
-			vec3 lights[2] = { {0,0,0}, {0,0,0} };
-			glUniform3fv(lights_loc, sizeof(lights) / sizeof(glm::vec3), reinterpret_cast<GLfloat*>(&lights[0]));
-		}
+void RenderSystem::setUniform3fv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const float* values, int count)
+{
+	GLint location = effect_locations[(int)effect].uniforms[(int)uniform];
+	if (location >= 0 && updateUniformCache(effect, uniform, values, sizeof(float) * 3 * count))
+		glUniform3fv(location, count, values);
+}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	}
+void RenderSystem::setUniform4fv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const vec4& value)
+{
+	GLint location = effect_locations[(int)effect].uniforms[(int)uniform];
+	if (location >= 0 && updateUniformCache(effect, uniform, &value, sizeof(value)))
+		glUniform4fv(location, 1, (float*)&value);
+}
+
+void RenderSystem::setUniform4fv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const vec4* values, int count)
+{
+	GLint location = effect_locations[(int)effect].uniforms[(int)uniform];
+	if (location >= 0 && updateUniformCache(effect, uniform, values, sizeof(vec4) * count))
+		glUniform4fv(location, count, (const float*)values);
+}
 
-	else if (render_request.used_effect == EFFECT_ASSET_ID::BLENDED) 
+void RenderSystem::setUniform1iv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const int* values, int count)
+{
+	GLint location = effect_locations[(int)effect].uniforms[(int)uniform];
+	if (location >= 0 && updateUniformCache(effect, uniform, values, sizeof(int) * count))
+		glUniform1iv(location, count, values);
+}
+
+void RenderSystem::setUniformMatrix3fv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const mat3& value)
+{
+	GLint location = effect_locations[(int)effect].uniforms[(int)uniform];
+	if (location >= 0 && updateUniformCache(effect, uniform, &value, sizeof(value)))
+		glUniformMatrix3fv(location, 1, GL_FALSE, (float*)&value);
+}
+
+void RenderSystem::updateLights()
+{
+	LightBlock block;
+	memset(&block, 0, sizeof(block));
+	block.light_count = (int)std::min(registry.lights.size(), (size_t)MAX_LIGHTS);
+	for (int i = 0; i < block.light_count; i++)
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
+		const Light& light = registry.lights.components[i];
+		block.lights[i] = vec4(light.position, light.intensity_dropoff_factor, 0.f);
+	}
+	if (memcmp(&block, &light_block, sizeof(block)) == 0)
+		return;
+	light_block = block;
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(TexturedVertex), (void*)0);
-		gl_has_errors();
+	glBindBuffer(GL_UNIFORM_BUFFER, lights_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlock), &light_block);
 
-		glEnableVertexAttribArray(in_texcoord_loc);
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-			(void*)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
+	// Texel centers sit at (t + 0.5) / ATTENUATION_LUT_SIZE of the range
+	std::vector<float> lut(ATTENUATION_LUT_SIZE * MAX_LIGHTS, 0.f);
+	for (int i = 0; i < light_block.light_count; i++)
+	{
+		const float drop_off = light_block.lights[i].z;
+		for (int t = 0; t < ATTENUATION_LUT_SIZE; t++)
+		{
+			float dist = (t + 0.5f) / ATTENUATION_LUT_SIZE * ATTENUATION_LUT_RANGE;
+			lut[i * ATTENUATION_LUT_SIZE + t] = 300.f / powf(dist, drop_off);
+		}
+	}
+	glActiveTexture(GL_TEXTURE0 + ATTENUATION_LUT_UNIT);
+	glBindTexture(GL_TEXTURE_2D, attenuation_lut);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ATTENUATION_LUT_SIZE, MAX_LIGHTS, GL_RED, GL_FLOAT, lut.data());
+	glActiveTexture(GL_TEXTURE0);
+	gl_has_errors();
+}
 
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
-		gl_has_errors();
+void RenderSystem::drawLightPass(const mat3& projection)
+{
+	// Without lights the lit effects don't sample the buffer
+	if (light_block.light_count == 0)
+		return;
 
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id = texture_gl_handles[(GLuint)render_request.used_texture];
+	glBindFramebuffer(GL_FRAMEBUFFER, light_frame_buffer);
+	glViewport(0, 0, window_width_px / LIGHT_BUFFER_DOWNSCALE, window_height_px / LIGHT_BUFFER_DOWNSCALE);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	gl_has_errors();
 
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
+	// One triangle covering the buffer, each pixel adds up every light
+	glUseProgram(effects[(GLuint)EFFECT_ASSET_ID::LIGHT_ACCUMULATION]);
+	setUniformMatrix3fv(EFFECT_ASSET_ID::LIGHT_ACCUMULATION, UNIFORM_ID::INVERSE_PROJECTION, inverse(projection));
+	glBindVertexArray(vertex_arrays[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
+	const GeometryInfo& triangle = geometry_infos[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE];
+	glDrawElements(GL_TRIANGLES, triangle.index_count, triangle.index_type, nullptr);
+	glBindVertexArray(default_vao);
+	gl_has_errors();
+	stats.draw_calls++;
+}
 
-		//glEnable(GL_BLEND);
-		//glBlendFunc(GL_ONE, GL_ONE);
-	}
-	else if (render_request.used_effect == EFFECT_ASSET_ID::OVERLAY_TEXTURED) 
+bool RenderSystem::isParallaxLayer(const RenderQueue::Item& item) const
+{
+	if (item.baked_run >= 0)
+		return false;
+	Entity entity = registry.renderRequests.entities[item.render_index];
+	const RenderRequest& render_request = registry.renderRequests.components[item.render_index];
+	if (render_request.layer != RENDER_LAYER::BACKGROUND || !registry.backgrounds.has(entity) || registry.colors.has(entity))
+		return false;
+	if (render_request.used_geometry != GEOMETRY_BUFFER_ID::SPRITE ||
+		(render_request.used_effect != EFFECT_ASSET_ID::TEXTURED && render_request.used_effect != EFFECT_ASSET_ID::BLENDED))
+		return false;
+
+	// createBackground's defaults, the texture covers the whole level
+	const Motion& motion = registry.motions.get(entity);
+	return motion.angle == 0.f && motion.reflect == vec2(0.f, 0.f) &&
+		motion.position == vec2(window_width_px / 2, window_height_px / 2) &&
+		motion.scale == vec2(window_width_px, window_height_px);
+}
+
+size_t RenderSystem::drawParallaxLayers(const std::vector<RenderQueue::Item>& items)
+{
+	std::array<TEXTURE_ASSET_ID, MAX_PARALLAX_LAYERS> textures;
+	std::array<vec4, MAX_PARALLAX_LAYERS> rects;
+	std::array<int, MAX_PARALLAX_LAYERS> flags;
+	int count = 0;
+	while (count < (int)items.size() && count < MAX_PARALLAX_LAYERS && isParallaxLayer(items[count]))
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
+		const uint i = items[count].render_index;
+		Entity entity = registry.renderRequests.entities[i];
+		const RenderRequest& render_request = registry.renderRequests.components[i];
+		// Layers are only built from uploaded textures, until then the sprites draw placeholders
+		if (texture_dimensions[(int)render_request.used_texture].x == 0)
+			return 0;
+
+		// The part of the texture the layer's camera sees, from the frame's bottom left to its
+		// top right corner
+		const Background& background = registry.backgrounds.get(entity);
+		const Camera& camera = background.depth > 0 ? background.parallaxCam : playerCamera;
+		textures[count] = render_request.used_texture;
+		rects[count] = vec4(camera.left / window_width_px, camera.bottom / window_height_px,
+			camera.right / window_width_px, camera.top / window_height_px);
+		flags[count] = render_request.used_effect == EFFECT_ASSET_ID::BLENDED ? SPRITE_FLAG_BLENDED : SPRITE_FLAG_LIT;
+		count++;
+	}
+	// A single background costs the same full screen draw either way
+	if (count < 2)
+		return 0;
+
+	if (count != parallax_layer_count || !std::equal(textures.begin(), textures.begin() + count, parallax_layer_textures.begin()))
+		buildParallaxLayers(textures.data(), count);
+
+	glUseProgram(effects[(GLuint)EFFECT_ASSET_ID::PARALLAX]);
+	setUniform4fv(EFFECT_ASSET_ID::PARALLAX, UNIFORM_ID::LAYER_RECTS, rects.data(), count);
+	setUniform1iv(EFFECT_ASSET_ID::PARALLAX, UNIFORM_ID::LAYER_FLAGS, flags.data(), count);
+	setUniform1i(EFFECT_ASSET_ID::PARALLAX, UNIFORM_ID::LAYER_COUNT, count);
+	// The light buffer covers the player camera's view, in the same coordinates as layer_rects
+	const vec4 light_rect = vec4(playerCamera.left / window_width_px, playerCamera.bottom / window_height_px,
+		playerCamera.right / window_width_px, playerCamera.top / window_height_px);
+	setUniform4fv(EFFECT_ASSET_ID::PARALLAX, UNIFORM_ID::LIGHT_RECT, light_rect);
+	glBindVertexArray(vertex_arrays[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
+	const GeometryInfo& triangle = geometry_infos[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE];
+	glDrawElements(GL_TRIANGLES, triangle.index_count, triangle.index_type, nullptr);
+	glBindVertexArray(default_vao);
+	gl_has_errors();
+	stats.draw_calls++;
+	stats.parallax_layers = count;
+	return (size_t)count;
+}
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(TexturedVertex), (void*)0);
-		gl_has_errors();
+vec4 RenderSystem::getUVRect(Entity entity, const RenderRequest& render_request) const
+{
+	const vec4& texture_rect = texture_uv_rects[(GLuint)render_request.used_texture];
+	if (render_request.used_geometry != GEOMETRY_BUFFER_ID::SPRITE_SHEET)
+		return texture_rect;
+
+	assert(registry.spriteSheets.has(entity));
+	vec4 frame = registry.spriteSheets.get(entity).getUVRect();
+	return {
+		texture_rect.x + frame.x * texture_rect.z,
+		texture_rect.y + frame.y * texture_rect.w,
+		frame.z * texture_rect.z,
+		frame.w * texture_rect.w };
+}
 
-		glEnableVertexAttribArray(in_texcoord_loc);
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-			(void*)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
+bool RenderSystem::isBatchable(const RenderRequest& render_request)
+{
+	bool is_sprite = render_request.used_geometry == GEOMETRY_BUFFER_ID::SPRITE ||
+		render_request.used_geometry == GEOMETRY_BUFFER_ID::SPRITE_SHEET;
+	bool is_textured = render_request.used_effect == EFFECT_ASSET_ID::TEXTURED ||
+		render_request.used_effect == EFFECT_ASSET_ID::OVERLAY_TEXTURED ||
+		render_request.used_effect == EFFECT_ASSET_ID::BLENDED;
+	return is_sprite && is_textured;
+}
 
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
-		gl_has_errors();
+SpriteInstance RenderSystem::makeSpriteInstance(Entity entity, const RenderRequest& render_request) const
+{
+	// Same transformation as drawTexturedMesh, ORDER IS IMPORTANT
+	Motion& motion = registry.motions.get(entity);
+	Transform transform;
+	transform.translate(motion.position);
+	transform.rotate(motion.angle);
+	transform.scale(motion.scale);
+	transform.reflect(motion.reflect);
 
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id = texture_gl_handles[(GLuint)render_request.used_texture];
+	SpriteInstance instance;
+	instance.transform = transform.mat;
+	instance.uv_rect = getUVRect(entity, render_request);
+	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
+	const float fading_factor = registry.fading.has(entity) ? registry.fading.get(entity).fading_factor : 0.f;
+	instance.color_fade = vec4(color, fading_factor);
+	if (render_request.used_effect == EFFECT_ASSET_ID::TEXTURED)
+		instance.flags = SPRITE_FLAG_LIT;
+	else if (render_request.used_effect == EFFECT_ASSET_ID::OVERLAY_TEXTURED)
+		instance.flags = SPRITE_FLAG_FADE;
+	else
+		instance.flags = SPRITE_FLAG_BLENDED;
+	return instance;
+}
 
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
+void RenderSystem::submitSprite(uint render_index, const mat3& projection)
+{
+	Entity entity = registry.renderRequests.entities[render_index];
+	const RenderRequest& render_request = registry.renderRequests.components[render_index];
 
-		// Fading
-		GLuint fade_timer_uloc = glGetUniformLocation(program, "fading_factor");
-		if (registry.fading.has(entity)) {
-			Fading& fade = registry.fading.get(entity);
-			glUniform1f(fade_timer_uloc, fade.fading_factor);
-		}
-		else {
-			glUniform1f(fade_timer_uloc, 0.f);
-		}
+	if (sprite_batch_projections.empty() || sprite_batch_projections.back() != projection)
+		sprite_batch_projections.push_back(projection);
+	int projection_index = (int)sprite_batch_projections.size() - 1;
+
+	if (!isBatchable(render_request))
+	{
+		sprite_batch_items.push_back({ 0, 0, render_request.used_effect, render_request.used_texture, projection_index, render_index });
+		return;
 	}
 
-	// FUTURE: won't need for now, could reuse if we end up having meshes
-	else if (render_request.used_effect == EFFECT_ASSET_ID::SPIKE)
+	sprite_instances.push_back(makeSpriteInstance(entity, render_request));
+
+	// Extend the current run if nothing would change between the draw calls
+	int instance_index = (int)sprite_instances.size() - 1;
+	if (!sprite_batch_items.empty())
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_color_loc = glGetAttribLocation(program, "in_color");
-		gl_has_errors();
+		SpriteBatchItem& last = sprite_batch_items.back();
+		// Compare the GL textures, atlas packed textures share them
+		if (last.count > 0 && !last.baked && last.effect == render_request.used_effect &&
+			texture_gl_handles[(GLuint)last.texture] == texture_gl_handles[(GLuint)render_request.used_texture] &&
+			last.projection == projection_index)
+		{
+			last.count++;
+			return;
+		}
+	}
+	sprite_batch_items.push_back({ instance_index, 1, render_request.used_effect, render_request.used_texture, projection_index, render_index });
+}
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(ColoredVertex), (void*)0);
-		gl_has_errors();
+void RenderSystem::submitBakedRun(int baked_run, const mat3& projection)
+{
+	if (sprite_batch_projections.empty() || sprite_batch_projections.back() != projection)
+		sprite_batch_projections.push_back(projection);
+	int projection_index = (int)sprite_batch_projections.size() - 1;
+
+	const BakedRun& run = baked_runs[baked_run];
+	sprite_batch_items.push_back({ run.first, run.count, EFFECT_ASSET_ID::TEXTURED, run.texture, projection_index, 0, true });
+}
+
+void RenderSystem::setSpriteInstanceAttributes(size_t first_instance)
+{
+	// GL 3.3 has no base instance for instanced draws, so each run points the instance
+	// attributes at its own part of the buffer instead
+	const size_t base = first_instance * sizeof(SpriteInstance);
+	const size_t offsets[] = {
+		base + offsetof(SpriteInstance, transform),
+		base + offsetof(SpriteInstance, transform) + sizeof(vec3),
+		base + offsetof(SpriteInstance, transform) + 2 * sizeof(vec3),
+		base + offsetof(SpriteInstance, uv_rect),
+		base + offsetof(SpriteInstance, color_fade),
+		base + offsetof(SpriteInstance, flags) };
+	const GLint sizes[] = { 3, 3, 3, 4, 4, 1 };
+	for (uint i = 0; i < 6; i++)
+	{
+		glVertexAttribPointer(ATTRIBUTE_INSTANCE_TRANSFORM + i, sizes[i], GL_FLOAT, GL_FALSE,
+			sizeof(SpriteInstance), (void*)offsets[i]);
+	}
+}
 
-		glEnableVertexAttribArray(in_color_loc);
-		glVertexAttribPointer(in_color_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(ColoredVertex), (void*)sizeof(vec3));
+void RenderSystem::flushSpriteBatch()
+{
+	// Upload all instances of the frame at once, orphaning last frame's storage
+	if (!sprite_instances.empty())
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, sprite_instance_buffer);
+		sprite_instance_capacity = std::max(sprite_instance_capacity, sprite_instances.size());
+		glBufferData(GL_ARRAY_BUFFER, sizeof(SpriteInstance) * sprite_instance_capacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(SpriteInstance) * sprite_instances.size(), sprite_instances.data());
 		gl_has_errors();
+	}
 
-		if (render_request.used_effect == EFFECT_ASSET_ID::SPIKE)
+	const GLuint program = effects[(GLuint)EFFECT_ASSET_ID::SPRITE_BATCH];
+	const GeometryInfo& quad = geometry_infos[(GLuint)GEOMETRY_BUFFER_ID::SPRITE];
+	bool batch_bound = false;
+	GLuint bound_instance_buffer = 0;
+	for (const SpriteBatchItem& item : sprite_batch_items)
+	{
+		const mat3& projection = sprite_batch_projections[item.projection];
+		if (item.count == 0)
 		{
-			// Light up?
-			GLint light_up_uloc = glGetUniformLocation(program, "light_up");
-			assert(light_up_uloc >= 0);
+			// Binds the vertex array object of its own geometry
+			batch_bound = false;
+			bound_instance_buffer = 0;
+			drawTexturedMesh(registry.renderRequests.entities[item.render_index], projection);
+			continue;
+		}
 
-			// !!! TODO A1: set the light_up shader variable using glUniform1i,
-			// similar to the glUniform1f call below. The 1f or 1i specified the type, here a single int.
+		if (!batch_bound)
+		{
+			glUseProgram(program);
+			glBindVertexArray(sprite_batch_vao);
+			glActiveTexture(GL_TEXTURE0);
 			gl_has_errors();
+			batch_bound = true;
 		}
-	}
-	else if (render_request.used_effect == EFFECT_ASSET_ID::WHEEL)
-	{
-		GLint wheelColor_uloc = glGetUniformLocation(program, "wheelColor");
-		GLint spikeColor_uloc = glGetUniformLocation(program, "spikeColor");
-		gl_has_errors();
 
-		// Define colors for the wheel and spikes
-		vec3 wheelColor = vec3(0.5f, 0.35f, 0.05); // Brown color for the wheel
-		vec3 spikeColor = vec3(0.628, 0.095, 0.990); // Purple color for the spikes
+		setUniformMatrix3fv(EFFECT_ASSET_ID::SPRITE_BATCH, UNIFORM_ID::PROJECTION, projection);
+		setUniformMatrix3fv(EFFECT_ASSET_ID::SPRITE_BATCH, UNIFORM_ID::LIGHT_PROJECTION, light_projection);
 
-		// Set the uniform values for the colors
-		glUniform3fv(wheelColor_uloc, 1, (float*)&wheelColor);
-		glUniform3fv(spikeColor_uloc, 1, (float*)&spikeColor);
-		gl_has_errors();
-
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_color_loc = glGetAttribLocation(program, "in_color");
+		bindSpriteTexture(item.texture);
+		const GLuint instance_buffer = item.baked ? baked_instance_buffer : sprite_instance_buffer;
+		if (instance_buffer != bound_instance_buffer)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+			bound_instance_buffer = instance_buffer;
+		}
+		setSpriteInstanceAttributes(item.first);
+		glDrawElementsInstanced(GL_TRIANGLES, quad.index_count, quad.index_type, nullptr, item.count);
 		gl_has_errors();
+		stats.draw_calls++;
+		stats.sprite_batches++;
+		stats.sprite_instances += item.count;
+	}
+	glBindVertexArray(default_vao);
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(ColoredVertex), (void*)0);
-		gl_has_errors();
+	sprite_instances.clear();
+	sprite_batch_items.clear();
+	sprite_batch_projections.clear();
+}
 
-		glEnableVertexAttribArray(in_color_loc);
-		glVertexAttribPointer(in_color_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(ColoredVertex), (void*)sizeof(vec3));
-		gl_has_errors();
+void RenderSystem::buildStaticLevel()
+{
+	struct BakedSprite
+	{
+		uint64_t key;
+		TEXTURE_ASSET_ID texture;
+		SpriteInstance instance;
+	};
+	std::vector<BakedSprite> sprites;
+	static_visibility_grid.clear();
+
+	// Static sprites are baked if they can be and bucketed into the visibility grid otherwise
+	auto addStatic = [&](Entity entity, bool can_bake) {
+		int i = registry.renderRequests.index(entity);
+		if (i < 0 || !registry.motions.has(entity))
+			return;
+		RenderRequest& render_request = registry.renderRequests.components[i];
+		const Motion& motion = registry.motions.get(entity);
+		if (motion.velocity != vec2(0.f, 0.f) || registry.keyframeAnimations.has(entity))
+			return;
+		if (can_bake && render_request.used_effect == EFFECT_ASSET_ID::TEXTURED &&
+			render_request.used_geometry == GEOMETRY_BUFFER_ID::SPRITE && !registry.spriteSheets.has(entity))
+		{
+			GLuint texture = texture_gl_handles[(GLuint)render_request.used_texture];
+			sprites.push_back({ RenderQueue::makeKey(render_request, texture), render_request.used_texture, makeSpriteInstance(entity, render_request) });
+			render_request.baked = true;
+			return;
+		}
+		// Light fixtures only take part in the bake
+		if (registry.lights.has(entity) || motion.angle != 0.f)
+			return;
+		vec2 half = abs(motion.scale) / 2.f;
+		static_visibility_grid.add(entity, motion.position - half, motion.position + half);
+		render_request.in_static_grid = true;
+	};
+	// Requests that stopped being static since the last build are drawn like any other
+	for (RenderRequest& render_request : registry.renderRequests.components)
+	{
+		render_request.baked = false;
+		render_request.in_static_grid = false;
 	}
-	else
+	for (Entity entity : registry.platforms.entities)
+		addStatic(entity, true);
+	for (Entity entity : registry.walls.entities)
+		addStatic(entity, true);
+	for (Entity entity : registry.climbables.entities)
+		addStatic(entity, true);
+	for (Entity entity : registry.lights.entities)
+		addStatic(entity, true);
+	for (uint i = 0; i < registry.backgrounds.size(); i++)
 	{
-		assert(false && "Type of render request not supported");
+		if (registry.backgrounds.components[i].depth <= 0.f)
+			addStatic(registry.backgrounds.entities[i], false);
+	}
+	static_visibility_grid.build();
+
+	// Sprites with the same key end up next to each other and form a run
+	std::stable_sort(sprites.begin(), sprites.end(), [](const BakedSprite& a, const BakedSprite& b) {
+		return a.key < b.key;
+	});
+	baked_runs.clear();
+	std::vector<SpriteInstance> instances;
+	instances.reserve(sprites.size());
+	for (const BakedSprite& sprite : sprites)
+	{
+		if (baked_runs.empty() || baked_runs.back().key != sprite.key)
+			baked_runs.push_back({ sprite.key, (int)instances.size(), 0, sprite.texture });
+		baked_runs.back().count++;
+		instances.push_back(sprite.instance);
 	}
+	baked_request_count = (int)sprites.size();
 
-	// Getting uniform locations for glUniform* calls
-	GLint color_uloc = glGetUniformLocation(program, "fcolor");
-	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
-	glUniform3fv(color_uloc, 1, (float*)&color);
+	glBindBuffer(GL_ARRAY_BUFFER, baked_instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(SpriteInstance) * instances.size(), instances.data(), GL_STATIC_DRAW);
 	gl_has_errors();
+}
 
-	// Get number of indices from index buffer, which has elements uint16_t
-	GLint size = 0;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	gl_has_errors();
+bool RenderSystem::isVisible(Entity entity) const
+{
+	// Overlays are placed in window coordinates
+	if (registry.overlay.has(entity))
+		return true;
+
+	const Camera* camera = &playerCamera;
+	if (registry.backgrounds.has(entity) && registry.backgrounds.get(entity).depth > 0)
+		camera = &registry.backgrounds.get(entity).parallaxCam;
+
+	const Motion& motion = registry.motions.get(entity);
+	vec2 half = abs(motion.scale) / 2.f;
+	if (motion.angle != 0.f)
+		half = vec2(length(motion.scale) / 2.f);
+	return motion.position.x + half.x >= camera->left && motion.position.x - half.x <= camera->right &&
+		motion.position.y + half.y >= camera->top && motion.position.y - half.y <= camera->bottom;
+}
 
-	GLsizei num_indices = size / sizeof(uint16_t);
-	// GLsizei num_triangles = num_indices / 3;
+void RenderSystem::buildRenderQueue(bool cull)
+{
+	render_queue.clear();
+	auto push = [&](uint i) {
+		const RenderRequest& render_request = registry.renderRequests.components[i];
+		GLuint texture = render_request.used_texture == TEXTURE_ASSET_ID::TEXTURE_COUNT ?
+			0 : texture_gl_handles[(GLuint)render_request.used_texture];
+		render_queue.push(RenderQueue::makeKey(render_request, texture), i);
+	};
+
+	// Static entities only cost the grid cells the camera overlaps
+	if (cull)
+	{
+		visible_static_entities.clear();
+		static_visibility_grid.query({ playerCamera.left, playerCamera.top }, { playerCamera.right, playerCamera.bottom }, visible_static_entities);
+		for (Entity entity : visible_static_entities)
+		{
+			int i = registry.renderRequests.index(entity);
+			if (i < 0 || !registry.motions.has(entity))
+				continue;
+			push((uint)i);
+		}
+	}
 
-	GLint currProgram;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
-	// Setting uniform values to the currently bound program
-	GLuint transform_loc = glGetUniformLocation(currProgram, "transform");
-	glUniformMatrix3fv(transform_loc, 1, GL_FALSE, (float*)&transform.mat);
-	GLuint projection_loc = glGetUniformLocation(currProgram, "projection");
-	glUniformMatrix3fv(projection_loc, 1, GL_FALSE, (float*)&projection);
-	gl_has_errors();
-	// Drawing of num_indices/3 triangles specified in the index buffer
-	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
-	gl_has_errors();
+	int total = 0;
+	int baked = 0;
+	for (uint i = 0; i < registry.renderRequests.entities.size(); i++)
+	{
+		Entity entity = registry.renderRequests.entities[i];
+		if (!registry.motions.has(entity))
+			continue;
+		total++;
+		const RenderRequest& render_request = registry.renderRequests.components[i];
+		// A level texture missing from the level's manifest is loaded on first use
+		if (render_request.used_texture != TEXTURE_ASSET_ID::TEXTURE_COUNT && !texture_requested[(int)render_request.used_texture])
+		{
+#ifndef NDEBUG
+			printf("Texture %d is not in the level's manifest\n", (int)render_request.used_texture);
+#endif
+			current_level_textures.push_back(render_request.used_texture);
+			texture_refcounts[(int)render_request.used_texture]++;
+			requestTexture(render_request.used_texture);
+		}
+		if (render_request.baked)
+		{
+			baked++;
+			continue;
+		}
+		if (cull && (render_request.in_static_grid || !isVisible(entity)))
+			continue;
+		push(i);
+	}
+
+	// A baked entity was removed since the level was loaded, bake again without it
+	if (baked != baked_request_count)
+	{
+		buildStaticLevel();
+		buildRenderQueue(cull);
+		return;
+	}
+
+	// The baked runs aren't culled, the GPU clips their off screen instances for free
+	for (uint run = 0; run < baked_runs.size(); run++)
+		render_queue.pushBaked(baked_runs[run].key, (int)run);
+	render_queue.sort();
+
+	stats.total_sprites = total;
+	stats.visible_sprites = (int)render_queue.getItems().size() - (int)baked_runs.size() + baked;
+}
+
+void RenderSystem::bindFrameTarget(float scale)
+{
+	// The water effect poisons, darkens and upscales the whole frame in one pass, without
+	// any of them it would only copy the frame
+	const ScreenState& screen = registry.screenStates.get(screen_state_entity);
+	frame_scale = scale;
+	frame_off_screen = frame_capture || screen.is_poisoned || screen.screen_darken_factor > 0.f || frame_scale < 1.f;
+	glBindFramebuffer(GL_FRAMEBUFFER, frame_off_screen ? frame_buffer : 0);
 }
 
 // draw the intermediate texture to the screen, with some distortion to simulate
 // water
 void RenderSystem::drawToScreen()
 {
+	// Already drawn into the window
+	if (!frame_off_screen)
+		return;
+
 	// Setting shaders
 	// get the water texture, sprite mesh, and program
 	glUseProgram(effects[(GLuint)EFFECT_ASSET_ID::WATER]);
@@ -293,96 +713,135 @@ void RenderSystem::drawToScreen()
 	glDisable(GL_DEPTH_TEST);
 
 	// Draw the screen texture on the quad geometry
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
-	glBindBuffer(
-		GL_ELEMENT_ARRAY_BUFFER,
-		index_buffers[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]); // Note, GL_ELEMENT_ARRAY_BUFFER associates
-	// indices to the bound GL_ARRAY_BUFFER
+	glBindVertexArray(vertex_arrays[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
 	gl_has_errors();
-	const GLuint water_program = effects[(GLuint)EFFECT_ASSET_ID::WATER];
 	// Set clock
-	GLuint time_uloc = glGetUniformLocation(water_program, "time");
-	GLuint dead_timer_uloc = glGetUniformLocation(water_program, "screen_darken_factor");
-	GLuint is_poisoned = glGetUniformLocation(water_program, "is_poisoned");
-	glUniform1f(time_uloc, (float)(glfwGetTime() * 10.0f));
+	setUniform1f(EFFECT_ASSET_ID::WATER, UNIFORM_ID::TIME, (float)(glfwGetTime() * 10.0f));
 	ScreenState& screen = registry.screenStates.get(screen_state_entity);
-	glUniform1f(dead_timer_uloc, screen.screen_darken_factor);
-	glUniform1f(is_poisoned, screen.is_poisoned);
-	gl_has_errors();
-	// Set the vertex position and vertex texture coordinates (both stored in the
-	// same VBO)
-	GLint in_position_loc = glGetAttribLocation(water_program, "in_position");
-	glEnableVertexAttribArray(in_position_loc);
-	glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
-	gl_has_errors();
-
-	// Bind our texture in Texture Unit 0
-	glActiveTexture(GL_TEXTURE0);
-
-	glBindTexture(GL_TEXTURE_2D, off_screen_render_buffer_color);
+	setUniform1f(EFFECT_ASSET_ID::WATER, UNIFORM_ID::SCREEN_DARKEN_FACTOR, screen.screen_darken_factor);
+	setUniform1i(EFFECT_ASSET_ID::WATER, UNIFORM_ID::IS_POISONED, screen.is_poisoned);
+	setUniform1f(EFFECT_ASSET_ID::WATER, UNIFORM_ID::FRAME_SCALE, frame_scale);
 	gl_has_errors();
+	// The screen texture stays bound to SCREEN_TEXTURE_UNIT
 	// Draw
+	const GeometryInfo& screen_triangle = geometry_infos[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE];
 	glDrawElements(
-		GL_TRIANGLES, 3, GL_UNSIGNED_SHORT,
+		GL_TRIANGLES, screen_triangle.index_count, screen_triangle.index_type,
 		nullptr); // one triangle = 3 vertices; nullptr indicates that there is
 	// no offset from the bound index buffer
 	gl_has_errors();
+	stats.draw_calls++;
+	glBindVertexArray(default_vao);
+}
+
+void RenderSystem::updateTextureStreaming()
+{
+	if (!texture_streamer.isDone())
+		stats.textures_uploaded += texture_streamer.upload(TEXTURE_UPLOAD_BUDGET_BYTES);
+}
+
+void RenderSystem::readFrame(std::vector<uint8_t>& rgba)
+{
+	const size_t row_size = (size_t)window_width_px * 4;
+	rgba.resize(row_size * window_height_px);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, frame_buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, window_width_px, window_height_px, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	gl_has_errors();
+
+	// GL reads bottom row first
+	std::vector<uint8_t> row(row_size);
+	for (int y = 0; y < window_height_px / 2; y++)
+	{
+		uint8_t* top = &rgba[y * row_size];
+		uint8_t* bottom = &rgba[(window_height_px - 1 - y) * row_size];
+		memcpy(row.data(), top, row_size);
+		memcpy(top, bottom, row_size);
+		memcpy(bottom, row.data(), row_size);
+	}
 }
 
 // Render our game world
 // http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-14-render-to-texture/
 void RenderSystem::draw(float elapsed_time_ms)
 {
+	beginFrameStats();
+	dynamic_resolution.beginFrame();
+	updateTextureStreaming();
+	updateLights();
+
+	float prevLeft = playerCamera.left;
+	updateCameraBounds(elapsed_time_ms);
+	float currLeft = playerCamera.left;
+
+	mat3 projection_2D = createProjectionMatrix(playerCamera.left, playerCamera.top, playerCamera.right, playerCamera.bottom);
+	mat3 projectionBasic = createBasicProjectionMatrix();
+	mat3 projectionParallax;
+
+	// Lighting of the level, before the sprites that sample it
+	light_projection = projection_2D;
+	drawLightPass(projection_2D);
+
 	// Getting size of window
 	int w, h;
 	glfwGetFramebufferSize(window, &w, &h); // Note, this will be 2x the resolution given to glfwCreateWindow on retina displays
 
-	// First render to the custom framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
+	// First render to the custom framebuffer, if there is a screen effect or the frame is
+	// drawn at a lower resolution. Captured frames are read back at the full resolution.
+	bindFrameTarget(frame_capture ? 1.f : dynamic_resolution.getScale());
 	gl_has_errors();
-	// Clearing backbuffer
-	glViewport(0, 0, window_width_px, window_height_px);
+	// Clearing backbuffer. Both targets are framebuffer sized, which is larger than the window
+	// on HiDPI displays.
+	glViewport(0, 0, (int)roundf(w * frame_scale), (int)roundf(h * frame_scale));
 	glDepthRange(0.00001, 10);
 	glClearColor(0, 0, 1, 1.0);
 	glClearDepth(10.f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // textures have premultiplied alpha
 	glDisable(GL_DEPTH_TEST); // native OpenGL does not work with a depth buffer
 	// and alpha blending, one would have to sort
 	// sprites back to front
 	gl_has_errors();
 
-	float prevLeft = playerCamera.left;
-	updateCameraBounds(elapsed_time_ms);
-	float currLeft = playerCamera.left;
-
-	mat3 projection_2D = createProjectionMatrix(playerCamera.left, playerCamera.top, playerCamera.right, playerCamera.bottom);
-	mat3 projectionBasic = createBasicProjectionMatrix();
-	mat3 projectionParallax;
+	// Scroll the parallax cameras first, culling tests the backgrounds against them
+	for (uint i = 0; i < registry.backgrounds.size(); i++)
+	{
+		Background& background = registry.backgrounds.components[i];
+		Entity entity = registry.backgrounds.entities[i];
+		if (background.depth <= 0 || !registry.renderRequests.has(entity) || !registry.motions.has(entity))
+			continue;
+		float horizontalShift = (currLeft - prevLeft) / background.depth; // horizontal shift inversely proportional to depth
+		vec4 clampedBounds = clampCam(background.parallaxCam.left + horizontalShift, playerCamera.top);
+		background.parallaxCam.left = clampedBounds[0];
+		background.parallaxCam.top = clampedBounds[1];
+		background.parallaxCam.right = clampedBounds[2];
+		background.parallaxCam.bottom = clampedBounds[3];
+	}
 
-	// Draw all textured meshes that have a position and size component
-	for (Entity entity : registry.renderRequests.entities)
+	// Draw all textured meshes that have a position and size component and can be seen, back to
+	// front, the backgrounds at the front of the queue all at once
+	buildRenderQueue(true);
+	const std::vector<RenderQueue::Item>& items = render_queue.getItems();
+	for (size_t item_index = drawParallaxLayers(items); item_index < items.size(); item_index++)
 	{
-		if (!registry.motions.has(entity))
+		const RenderQueue::Item& item = items[item_index];
+		if (item.baked_run >= 0)
+		{
+			submitBakedRun(item.baked_run, projection_2D);
 			continue;
-		// Note, its not very efficient to access elements indirectly via the entity
-		// albeit iterating through all Sprites in sequence. A good point to optimize
+		}
+		const uint i = item.render_index;
+		Entity entity = registry.renderRequests.entities[i];
 		bool isParallax = false;
 		if (registry.backgrounds.has(entity))
 		{
-			Background& background = registry.backgrounds.get(entity);
 			// adjust projection matrix based on depth of scrolling background
+			const Background& background = registry.backgrounds.get(entity);
 			if (background.depth > 0)
 			{
 				isParallax = true;
-				float horizontalShift = (currLeft - prevLeft) / background.depth; // horizontal shift inversely proportional to depth
-				vec4 clampedBounds = clampCam(background.parallaxCam.left + horizontalShift, playerCamera.top);
-				background.parallaxCam.left = clampedBounds[0];
-				background.parallaxCam.top = clampedBounds[1];
-				background.parallaxCam.right = clampedBounds[2];
-				background.parallaxCam.bottom = clampedBounds[3];
-
 				projectionParallax = createProjectionMatrix(
 					background.parallaxCam.left,
 					background.parallaxCam.top,
@@ -392,33 +851,43 @@ void RenderSystem::draw(float elapsed_time_ms)
 		}
 
 		if (registry.overlay.has(entity)) {
-			drawTexturedMesh(entity, projectionBasic);
+			submitSprite(i, projectionBasic);
 		}
 		else {
 
 			if (isParallax)
-				drawTexturedMesh(entity, projectionParallax);
+				submitSprite(i, projectionParallax);
 			else
-				drawTexturedMesh(entity, projection_2D);
+				submitSprite(i, projection_2D);
 
 		}
 	}
+	flushSpriteBatch();
 
 	// Truely render to the screen
 	drawToScreen();
+	dynamic_resolution.endFrame();
+	stats.render_scale = frame_scale;
+	stats.gpu_frame_ms = dynamic_resolution.getGpuFrameMs();
 
 	// flicker-free display with a double buffer
 	glfwSwapBuffers(window);
 	gl_has_errors();
+	endFrameStats();
 }
 
 void RenderSystem::drawMenu(float elapsed_time_ms) {
+	beginFrameStats();
+	updateTextureStreaming();
+	updateLights();
+	drawLightPass(createBasicProjectionMatrix());
+
   // Getting size of window
 	int w, h;
 	glfwGetFramebufferSize(window, &w, &h); // Note, this will be 2x the resolution given to glfwCreateWindow on retina displays
 
-	// First render to the custom framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
+	// First render to the custom framebuffer, if there is a screen effect
+	bindFrameTarget(1.f);
 	gl_has_errors();
 	// Clearing backbuffer
 	glViewport(0, 0, w, h);
@@ -427,21 +896,23 @@ void RenderSystem::drawMenu(float elapsed_time_ms) {
 	glClearDepth(10.f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // textures have premultiplied alpha
 	glDisable(GL_DEPTH_TEST); // native OpenGL does not work with a depth buffer
 							  // and alpha blending, one would have to sort
 							  // sprites back to front
 	gl_has_errors();
 	mat3 projection_2D = createBasicProjectionMatrix();
-	// Draw all textured meshes that have a position and size component
-	for (Entity entity : registry.renderRequests.entities)
+	light_projection = projection_2D;
+	// Draw all textured meshes that have a position and size component, back to front
+	buildRenderQueue(false);
+	for (const RenderQueue::Item& item : render_queue.getItems())
 	{
-		if (!registry.motions.has(entity))
-			continue;
-		// Note, its not very efficient to access elements indirectly via the entity
-		// albeit iterating through all Sprites in sequence. A good point to optimize
-		drawTexturedMesh(entity, projection_2D);
+		if (item.baked_run >= 0)
+			submitBakedRun(item.baked_run, projection_2D);
+		else
+			submitSprite(item.render_index, projection_2D);
 	}
+	flushSpriteBatch();
 
 	// Truely render to the screen
 	drawToScreen();
@@ -449,6 +920,7 @@ void RenderSystem::drawMenu(float elapsed_time_ms) {
 	// flicker-free display with a double buffer
 	glfwSwapBuffers(window);
 	gl_has_errors();
+	endFrameStats();
 }
 
 void RenderSystem::step(float elapsed_time_ms) {
@@ -463,8 +935,6 @@ void RenderSystem::step(float elapsed_time_ms) {
 			if (sheet.offset.x / sheet.spriteDim.x >= sheet.getCurrentSpriteCount()) {
 				sheet.offset.x = 0.f;
 			}
-
-			updateSpriteSheetGeometryBuffer(sheet);
 		}
 	}
 }
@@ -520,69 +990,9 @@ vec4 RenderSystem::getCameraBounds() {
 	return { playerCamera.left, playerCamera.top, playerCamera.right, playerCamera.bottom };
 }
 
-void RenderSystem::resetSpriteSheetTracker() {
-	std::fill_n(bufferIds, sizeof(bufferIds) / sizeof(int), -1);
-
-	for (int i = 0; i < geometry_count; i++)
-	{
-		bufferIds[i] = i;
-	}
-}
-
-template <class T>
-void RenderSystem::bindVBOandIBO(uint gid, std::vector<T> vertices, std::vector<uint16_t> indices) {
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[gid]);
-	glBufferData(GL_ARRAY_BUFFER,
-		sizeof(vertices[0]) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-	gl_has_errors();
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[gid]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
-	gl_has_errors();
-}
-
 void RenderSystem::initializeSpriteSheet(Entity& entity, ANIMATION_MODE defaultMode, std::vector<int> spriteCounts, float switchTime, vec2 trunc) {
-	GLuint id = findFirstAvailableBufferSlot();
-	assert(id != -1);
-	bufferIds[id] = id;
-
-	SpriteSheet& sheet = registry.spriteSheets.emplace(entity, SpriteSheet(id, defaultMode, spriteCounts, switchTime, trunc));
-
-	std::vector<TexturedVertex> textured_vertices(4);
-	textured_vertices[0].position = { -1.f / 2, +1.f / 2, 0.f };
-	textured_vertices[1].position = { +1.f / 2, +1.f / 2, 0.f };
-	textured_vertices[2].position = { +1.f / 2, -1.f / 2, 0.f };
-	textured_vertices[3].position = { -1.f / 2, -1.f / 2, 0.f };
-
-	textured_vertices[0].texcoord = { sheet.offset.x, sheet.offset.y + sheet.spriteDim.y };
-	textured_vertices[1].texcoord = { sheet.offset.x + sheet.spriteDim.x - sheet.truncation.x, sheet.offset.y + sheet.spriteDim.y };
-	textured_vertices[2].texcoord = { sheet.offset.x + sheet.spriteDim.x - sheet.truncation.x, sheet.offset.y + sheet.truncation.y };
-	textured_vertices[3].texcoord = { sheet.offset.x, sheet.offset.y + sheet.truncation.y };
-
-	// Counterclockwise as it's the default opengl front winding direction.
-	const std::vector<uint16_t> textured_indices = { 0, 3, 1, 1, 3, 2 };
-	bindVBOandIBO(sheet.bufferId, textured_vertices, textured_indices);
-}
-
-void RenderSystem::updateSpriteSheetGeometryBuffer(SpriteSheet& sheet) {
-	assert(sheet.spriteDim.x > 0);
-	assert(sheet.spriteDim.y > 0);
-
-	std::vector<TexturedVertex> textured_vertices(4);
-	textured_vertices[0].position = { -1.f / 2, +1.f / 2, 0.f };
-	textured_vertices[1].position = { +1.f / 2, +1.f / 2, 0.f };
-	textured_vertices[2].position = { +1.f / 2, -1.f / 2, 0.f };
-	textured_vertices[3].position = { -1.f / 2, -1.f / 2, 0.f };
-
-	textured_vertices[0].texcoord = { sheet.offset.x, sheet.offset.y + sheet.spriteDim.y };
-	textured_vertices[1].texcoord = { sheet.offset.x + sheet.spriteDim.x - sheet.truncation.x, sheet.offset.y + sheet.spriteDim.y };
-	textured_vertices[2].texcoord = { sheet.offset.x + sheet.spriteDim.x - sheet.truncation.x, sheet.offset.y + sheet.truncation.y };
-	textured_vertices[3].texcoord = { sheet.offset.x, sheet.offset.y + sheet.truncation.y };
-
-	// Counterclockwise as it's the default opengl front winding direction.
-	const std::vector<uint16_t> textured_indices = { 0, 3, 1, 1, 3, 2 };
-	bindVBOandIBO(sheet.bufferId, textured_vertices, textured_indices);
+	// No buffers of its own, the frame is picked from the texture with SpriteSheet::getUVRect()
+	registry.spriteSheets.emplace(entity, SpriteSheet(defaultMode, spriteCounts, switchTime, trunc));
 }
 
 void RenderSystem::updateCameraBounds(float elapsed_time_ms)
@@ -690,19 +1100,3 @@ vec4 RenderSystem::clampCam(float left, float top)
 
 	return { left, top, right, bottom };
 }
-
-int RenderSystem::findFirstAvailableBufferSlot()
-{
-	int size = sizeof(bufferIds) / sizeof(int);
-	for (int i = geometry_count; i < size; i++)
-	{
-		if (bufferIds[i] == -1)
-			return i;
-	}
-	return -1;
-}
-
-void RenderSystem::deleteBufferId(int index) {
-	assert(index >= geometry_count && index < sizeof(bufferIds) / sizeof(int));
-	bufferIds[index] = -1;
-}
\ No newline at end of file
@@ -6,6 +6,149 @@
 #include "common.hpp"
 #include "components.hpp"
 #include "tiny_ecs.hpp"
+#include "render_queue.hpp"
+#include "raycast.hpp"
+#include "texture_streamer.hpp"
+#include "dynamic_resolution.hpp"
+
+// Per sprite data of the instanced sprite batch, layout matches sprite_batch.vs.glsl
+struct SpriteInstance
+{
+	mat3 transform;
+	vec4 uv_rect;    // xy - offset, zw - size of the sprite's part of the texture
+	vec4 color_fade; // rgb - colour, a - fading factor
+	float flags;     // SPRITE_FLAGS
+};
+
+// Which effect a batched sprite was requested with, keep in sync with sprite_batch.fs.glsl
+enum SPRITE_FLAGS
+{
+	SPRITE_FLAG_LIT = 1,
+	SPRITE_FLAG_FADE = 2,
+	SPRITE_FLAG_BLENDED = 4
+};
+
+// Uniforms of the effects whose locations are resolved once at initialization
+enum class UNIFORM_ID
+{
+	TRANSFORM = 0,
+	PROJECTION = TRANSFORM + 1,
+	FCOLOR = PROJECTION + 1,
+	ATTENUATION_LUT = FCOLOR + 1,
+	FADING_FACTOR = ATTENUATION_LUT + 1,
+	LIGHT_UP = FADING_FACTOR + 1,
+	WHEEL_COLOR = LIGHT_UP + 1,
+	SPIKE_COLOR = WHEEL_COLOR + 1,
+	TIME = SPIKE_COLOR + 1,
+	SCREEN_DARKEN_FACTOR = TIME + 1,
+	IS_POISONED = SCREEN_DARKEN_FACTOR + 1,
+	UV_RECT = IS_POISONED + 1,
+	LIGHT_BUFFER = UV_RECT + 1,
+	INVERSE_PROJECTION = LIGHT_BUFFER + 1,
+	SCREEN_TEXTURE = INVERSE_PROJECTION + 1,
+	FRAME_SCALE = SCREEN_TEXTURE + 1,
+	LAYERS = FRAME_SCALE + 1,
+	LAYER_RECTS = LAYERS + 1,
+	LAYER_FLAGS = LAYER_RECTS + 1,
+	LAYER_COUNT = LAYER_FLAGS + 1,
+	LIGHT_PROJECTION = LAYER_COUNT + 1,
+	LIGHT_RECT = LIGHT_PROJECTION + 1,
+	UNIFORM_COUNT = LIGHT_RECT + 1
+};
+const int uniform_count = (int)UNIFORM_ID::UNIFORM_COUNT;
+
+// Vertex attribute locations, fixed with layout(location = N) in the vertex shaders so
+// a vertex array object works with every effect that uses the same vertex format
+enum ATTRIBUTE_LOCATION
+{
+	ATTRIBUTE_POSITION = 0,
+	ATTRIBUTE_TEXCOORD = 1, // TexturedVertex
+	ATTRIBUTE_COLOR = 1,    // ColoredVertex
+	ATTRIBUTE_INSTANCE_TRANSFORM = 2, // 3 columns, locations 2 to 4
+	ATTRIBUTE_INSTANCE_UV_RECT = 5,
+	ATTRIBUTE_INSTANCE_COLOR_FADE = 6,
+	ATTRIBUTE_INSTANCE_FLAGS = 7
+};
+
+// Lights, uploaded once per frame into a uniform buffer. Layout matches the std140
+// LightBlock of light_accumulation.fs.glsl, textured.fs.glsl, sprite_batch.fs.glsl and
+// parallax.fs.glsl.
+const int MAX_LIGHTS = 32;
+struct LightBlock
+{
+	vec4 lights[MAX_LIGHTS]; // xy - position, z - drop-off exponent
+	int light_count;
+	int padding[3];
+};
+const GLuint LIGHTS_BLOCK_BINDING = 0;
+
+// The lit effects look up a light's attenuation, 300 / dist^drop_off, in a texture with one
+// row per light instead of computing pow per fragment. Rows cover 0 to ATTENUATION_LUT_RANGE
+// pixels, keep the range in sync with the shaders.
+const int ATTENUATION_LUT_SIZE = 1024;
+const float ATTENUATION_LUT_RANGE = 2048.f;
+const GLuint ATTENUATION_LUT_UNIT = 1;
+
+// The light pass adds up all lights once per pixel of the light buffer, a fraction of the
+// frame's resolution, and the lit effects sample it instead of looping over the lights.
+// r - summed intensity, g - inside a light's bright radius
+const int LIGHT_BUFFER_DOWNSCALE = 4;
+const GLuint LIGHT_BUFFER_UNIT = 2;
+
+// Sprites are all drawn from texture unit 0, with sprite_sampler bound to it for good. The
+// off-screen frame has no mips and stays bound to its own unit for the screen pass.
+const GLuint SPRITE_TEXTURE_UNIT = 0;
+const GLuint SCREEN_TEXTURE_UNIT = 3;
+
+// The level's full screen backgrounds are copied into the layers of one texture array and
+// composited with a single full screen draw, each layer offset by its parallax camera,
+// instead of one overlapping full screen draw per background. Keep in sync with
+// parallax.fs.glsl.
+const int MAX_PARALLAX_LAYERS = 8;
+const GLuint PARALLAX_LAYERS_UNIT = 4;
+
+// Textures are decoded by worker threads and uploaded at most this many bytes per frame, the
+// menu's textures first
+const size_t TEXTURE_UPLOAD_BUDGET_BYTES = 8 * 1024 * 1024;
+const int MAX_TEXTURE_STREAMING_WORKERS = 4;
+
+// Level textures released by the previous levels stay loaded while all loaded level textures
+// fit in this many bytes, the least recently released are unloaded first. Levels are played
+// in order, so this only has to hold the level just left for a trip through the menu and
+// back, the tutorial, bus loop and lab sets are larger and always reload.
+const size_t DEFAULT_TEXTURE_BUDGET_BYTES = 64 * 1024 * 1024;
+
+// Uniform locations of one effect, -1 if the effect doesn't use it
+struct EffectLocations
+{
+	std::array<GLint, uniform_count> uniforms;
+};
+
+// Counters of the last drawn frame
+struct RenderStats
+{
+	int draw_calls = 0;
+	int sprite_instances = 0;
+	int sprite_batches = 0;
+	int uniform_uploads = 0;
+	int uniform_uploads_skipped = 0;
+	int gl_state_queries = 0; // only the GPU timer polls, drawing uses the sizes recorded at upload
+	int gl_error_queries = 0;
+	int visible_sprites = 0; // render requests left after camera culling
+	int total_sprites = 0;
+	int textures_uploaded = 0;
+	int parallax_layers = 0; // backgrounds drawn by the parallax compositor
+	float render_scale = 1.f; // of the frame's resolution, see DynamicResolution
+	float gpu_frame_ms = 0.f; // recent average
+};
+
+// What bindVBOandIBO uploaded into a geometry's buffers, so drawing never has to ask GL
+struct GeometryInfo
+{
+	GLsizei vertex_count = 0;
+	GLsizei index_count = 0;
+	GLenum index_type = GL_UNSIGNED_SHORT;
+};
 
 // System responsible for setting up OpenGL and for rendering all the
 // visual entities in the game
@@ -20,6 +163,11 @@ class RenderSystem
 	 */
 	std::array<GLuint, texture_count> texture_gl_handles;
 	std::array<ivec2, texture_count> texture_dimensions;
+	// Part of the GL texture each texture asset covers as offset (xy) and scale (zw),
+	// the whole texture unless it was packed into an atlas page (UBZ_TEXTURE_ATLAS)
+	std::array<vec4, texture_count> texture_uv_rects;
+	std::array<bool, texture_count> texture_in_atlas = {};
+	std::vector<GLuint> atlas_page_handles;
 
 	vec2 lastRestingPlayerPos;
 	bool lastPlayerDirectionIsPos = true; // true = +x, false = -x
@@ -225,30 +373,76 @@ class RenderSystem
 		shader_path("textured"),
 		shader_path("overlay"),
 		shader_path("blended"),
-		shader_path("water") };
-
-	// TODO (Justin): update size of array if we exceed 50 sprite sheet entities
-	std::array<GLuint, 50> vertex_buffers;
-	std::array<GLuint, 50> index_buffers;
+		shader_path("water"),
+		shader_path("sprite_batch"),
+		shader_path("light_accumulation"),
+		shader_path("parallax") };
+
+	// Make sure these names remain in sync with the associated enumerators.
+	const std::array<std::string, uniform_count> uniform_names = {
+		"transform",
+		"projection",
+		"fcolor",
+		"attenuation_lut",
+		"fading_factor",
+		"light_up",
+		"wheelColor",
+		"spikeColor",
+		"time",
+		"screen_darken_factor",
+		"is_poisoned",
+		"uv_rect",
+		"light_buffer",
+		"inverse_projection",
+		"screen_texture",
+		"frame_scale",
+		"layers",
+		"layer_rects",
+		"layer_flags",
+		"layer_count",
+		"light_projection",
+		"light_rect" };
+	std::array<EffectLocations, effect_count> effect_locations;
+
+	// Last value uploaded to each uniform of each effect, uploads of the same value are skipped
+	std::array<std::array<std::vector<uint8_t>, uniform_count>, effect_count> uniform_cache;
+
+	std::array<GLuint, geometry_count> vertex_buffers;
+	std::array<GLuint, geometry_count> index_buffers;
+	// One vertex array object per geometry holding its buffers and vertex format
+	std::array<GLuint, geometry_count> vertex_arrays;
+	std::array<GeometryInfo, geometry_count> geometry_infos;
 	std::array<Mesh, geometry_count> meshes;
 
-	// vertex and index buffers for sprite sheets
-	std::vector<GLuint> sprite_vertex_buffers;
-	std::vector<GLuint> sprite_index_buffers;
-
 public:
-	uint spriteSheetBuffersCount = 0;
 	// Initialize the window
 	bool init(GLFWwindow* window);
 
 	template <class T>
 	void bindVBOandIBO(GEOMETRY_BUFFER_ID gid, std::vector<T> vertices, std::vector<uint16_t> indices);
 
-	template <class T>
-	void bindVBOandIBO(uint gid, std::vector<T> vertices, std::vector<uint16_t> indices);
-
+	// Hands every texture a placeholder and queues its file for streaming
 	void initializeGlTextures();
 
+	// Fraction of the textures uploaded so far, 1 once all of them are
+	float getTextureLoadProgress() const;
+	bool texturesLoaded() const { return texture_streamer.isDone(); }
+	// Textures uploaded so far, and how many of those came from the cooked cache
+	int getLoadedTextureCount() const { return texture_streamer.getUploadedCount(); }
+	int getCookedTextureCount() const { return texture_streamer.getCookedCount(); }
+	// Blocks until every texture is uploaded, before drawing anything that must not show placeholders
+	void finishTextureLoading();
+
+	// Textures that belong to levels are only loaded while a level uses them, all other
+	// textures are queued for loading now. Call once before the first level.
+	void setLevelTextures(const std::vector<TEXTURE_ASSET_ID>& textures);
+	// Loads the level's textures, releases the previous level's and unloads released ones
+	// over the budget
+	void useLevelTextures(const std::vector<TEXTURE_ASSET_ID>& textures);
+	void setTextureBudget(size_t bytes) { texture_budget_bytes = bytes; }
+	// Bytes of the level textures currently loaded, mips included
+	size_t getLevelTextureBytes() const;
+
 	void initializeGlEffects();
 
 	void initializeGlMeshes();
@@ -256,8 +450,6 @@ public:
 
 	void initializeGlGeometryBuffers();
 
-	void updateSpriteSheetGeometryBuffer(SpriteSheet& sheet);
-
 	// Initialize the screen texture used as intermediate render target
 	// The draw loop first renders to this texture, then it is used for the water
 	// shader
@@ -283,17 +475,100 @@ public:
 
 	vec4 getCameraBounds();
 
-	void resetSpriteSheetTracker();
+	const RenderStats& getStats() const { return stats; }
+
+	// Reads back the last drawn frame from the off-screen framebuffer, before the screen
+	// effect, as window_width_px x window_height_px RGBA with the top row first. Needs
+	// setFrameCapture(true) before the frame is drawn.
+	void readFrame(std::vector<uint8_t>& rgba);
+	// Keep drawing frames off-screen even without a screen effect, so readFrame can read them
+	void setFrameCapture(bool capture) { frame_capture = capture; }
 
-	static void deleteBufferId(int index);
+	// Draw the game at a fixed fraction of the window's resolution, 0 to pick it from the GPU
+	// frame times, see DynamicResolution
+	void setRenderScale(float scale) { dynamic_resolution.setFixedScale(scale); }
+	void setGpuFrameTarget(float ms) { dynamic_resolution.setTarget(ms); }
+
+	// Bake the level's static geometry and bucket its static backgrounds for culling, call
+	// once the level has been created. Static platforms, walls, climbables and light fixtures
+	// are baked into one instance buffer, grouped by their sort key. Each group is drawn with
+	// a single instanced draw no matter how many tiles it has, and takes the place of its
+	// requests in the render queue. Static requests that weren't baked (the backgrounds) are
+	// culled through a grid, everything else is tested one by one.
+	void buildStaticLevel();
 
 private:
 	// Internal drawing functions for each entity type
 	void drawTexturedMesh(Entity entity, const mat3& projection);
+
+	// Texture coordinates to draw the request with, the sprite sheet frame within the
+	// texture's atlas rectangle
+	vec4 getUVRect(Entity entity, const RenderRequest& render_request) const;
+
+	// Fill render_queue with every request that has a motion, sorted by layer and GPU state.
+	// With cull, requests outside the camera (or their parallax camera) are left out.
+	void buildRenderQueue(bool cull);
+	bool isVisible(Entity entity) const;
+
+	// Reset the stats at the start of a frame and collect the GL query counts at its end
+	void beginFrameStats();
+	void endFrameStats();
+
+	// Sprite batching: submitSprite() collects the TEXTURED, OVERLAY_TEXTURED and BLENDED sprites
+	// of a frame into one instance buffer, flushSpriteBatch() then draws each run of consecutive
+	// sprites with the same effect, texture and projection with a single instanced draw call.
+	// Everything else is drawn with drawTexturedMesh() in between, keeping the draw order.
+	void initializeSpriteBatch();
+	SpriteInstance makeSpriteInstance(Entity entity, const RenderRequest& render_request) const;
+	void submitSprite(uint render_index, const mat3& projection);
+	void submitBakedRun(int baked_run, const mat3& projection);
+	void flushSpriteBatch();
+	void setSpriteInstanceAttributes(size_t first_instance);
+	static bool isBatchable(const RenderRequest& render_request);
+
+	// Record the vertex buffer layout in the currently bound vertex array object, the
+	// pointer only selects the overload
+	static void setVertexFormat(const TexturedVertex*);
+	static void setVertexFormat(const ColoredVertex*);
+	static void setVertexFormat(const vec3*);
+
+	// Upload a uniform of the effect unless it already has that value. The effect's program
+	// has to be in use.
+	bool updateUniformCache(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const void* data, size_t bytes);
+	void setUniform1i(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, int value);
+	void setUniform1f(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, float value);
+	void setUniform3fv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const float* values, int count);
+	void setUniform4fv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const vec4& value);
+	void setUniform4fv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const vec4* values, int count);
+	void setUniform1iv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const int* values, int count);
+	void setUniformMatrix3fv(EFFECT_ASSET_ID effect, UNIFORM_ID uniform, const mat3& value);
+	void initializeLights();
+	void initializeSamplers();
+	// Bind the texture to SPRITE_TEXTURE_UNIT, which has to be active, with its sampler
+	void bindSpriteTexture(TEXTURE_ASSET_ID texture);
+	void initializeParallaxLayers();
+	// Upload the textures that finished decoding, up to the frame's budget
+	void updateTextureStreaming();
+	void requestTexture(TEXTURE_ASSET_ID id);
+	// Unload released level textures, least recently released first, until under the budget
+	void evictLevelTextures();
+	// Upload the lights and their attenuation rows if they changed since the last frame
+	void updateLights();
+	// Fill the light buffer for a frame drawn with projection, binds the light framebuffer
+	void drawLightPass(const mat3& projection);
+	// Parallax compositor: draws the leading full screen backgrounds of the render queue in
+	// one pass and returns how many items that covers, 0 if they are left to the sprites
+	size_t drawParallaxLayers(const std::vector<RenderQueue::Item>& items);
+	bool isParallaxLayer(const RenderQueue::Item& item) const;
+	// Copy the textures into the layers of the texture array, resizing it to the largest
+	void buildParallaxLayers(const TEXTURE_ASSET_ID* textures, int count);
+	// Frames are drawn off-screen and then through the water effect only while the screen is
+	// poisoned or darkened or the frame is drawn at a lower resolution, otherwise straight
+	// into the window. Binds the framebuffer to draw the frame into.
+	void bindFrameTarget(float scale);
 	void drawToScreen();
 	void updateCameraBounds(float elapsed_time_ms);
 	vec4 clampCam(float left, float top);
-	int findFirstAvailableBufferSlot();
 
 	// Window handle
 	GLFWwindow* window;
@@ -302,8 +577,80 @@ private:
 	GLuint frame_buffer;
 	GLuint off_screen_render_buffer_color;
 	GLuint off_screen_render_buffer_depth;
+	bool frame_capture = false;
+	bool frame_off_screen = true; // whether the frame being drawn goes through drawToScreen
+	float frame_scale = 1.f; // of the frame being drawn, upscaled by drawToScreen
+	DynamicResolution dynamic_resolution;
 
 	Entity screen_state_entity;
+
+	// One run of batched sprites, or a single entity drawn with drawTexturedMesh if count is 0
+	struct SpriteBatchItem
+	{
+		int first;
+		int count;
+		EFFECT_ASSET_ID effect;
+		TEXTURE_ASSET_ID texture;
+		int projection;   // index into sprite_batch_projections
+		uint render_index; // index into registry.renderRequests
+		bool baked = false; // first indexes baked_instance_buffer instead of this frame's instances
+	};
+
+	struct BakedRun
+	{
+		uint64_t key; // RenderQueue key of the requests it replaces
+		int first;
+		int count;
+		TEXTURE_ASSET_ID texture;
+	};
+
+	GLuint default_vao;
+	GLuint sprite_batch_vao;
+	GLuint sprite_instance_buffer;
+	size_t sprite_instance_capacity = 0;
+	std::vector<SpriteInstance> sprite_instances;
+	std::vector<SpriteBatchItem> sprite_batch_items;
+	std::vector<mat3> sprite_batch_projections;
+
+	// Standalone textures use sprite_sampler, atlas pages atlas_sampler (UBZ_TEXTURE_ATLAS)
+	GLuint sprite_sampler;
+	GLuint atlas_sampler = 0;
+	GLuint bound_sprite_sampler = 0;
+
+	GLuint lights_buffer;
+	GLuint attenuation_lut;
+	GLuint light_frame_buffer;
+	GLuint light_buffer;
+	LightBlock light_block;
+	// Projection the light buffer was drawn with, lit sprites look their world position up
+	// in it whatever projection they are drawn with
+	mat3 light_projection = mat3(1.f);
+
+	GLuint parallax_layers;
+	GLuint parallax_copy_frame_buffers[2]; // read and draw, for the copies into the layers
+	std::array<TEXTURE_ASSET_ID, MAX_PARALLAX_LAYERS> parallax_layer_textures; // what the layers hold
+	int parallax_layer_count = 0;
+
+	GLuint baked_instance_buffer;
+	std::vector<BakedRun> baked_runs;
+	int baked_request_count = 0;
+
+	TextureStreamer texture_streamer;
+	// Level texture residency, see useLevelTextures
+	std::array<bool, texture_count> texture_level_scoped = {};
+	std::array<bool, texture_count> texture_requested = {}; // queued or loaded, not unloaded since
+	std::array<int, texture_count> texture_refcounts = {};
+	std::array<unsigned int, texture_count> texture_release_order = {};
+	unsigned int texture_release_count = 0;
+	std::vector<TEXTURE_ASSET_ID> current_level_textures;
+	size_t texture_budget_bytes = DEFAULT_TEXTURE_BUDGET_BYTES;
+
+	RenderStats stats;
+	RenderQueue render_queue;
+	BoxGrid static_visibility_grid = BoxGrid(256.f);
+	std::vector<Entity> visible_static_entities;
+	unsigned int frame_state_query_start = 0;
+	unsigned int frame_error_query_start = 0;
 };
 
 bool loadEffectFromFile(
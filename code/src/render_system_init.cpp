@@ -1,11 +1,19 @@
 // internal
 #include "render_system.hpp"
+#include "cooked_texture.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
 #include <fstream>
 
 #include "../ext/stb_image/stb_image.h"
 
+#ifdef UBZ_TEXTURE_ATLAS
+// Generated by the texture_atlas target
+#include "texture_atlas.hpp"
+#endif
+
 // This creates circular header inclusion, that is quite bad.
 #include "tiny_ecs_registry.hpp"
 
@@ -26,6 +34,9 @@ bool RenderSystem::init(GLFWwindow* window_arg)
 	const int is_fine = gl3w_init();
 	assert(is_fine == 0);
 
+	// Debug builds report GL errors through a callback instead of polling glGetError
+	gl_enable_debug_output();
+
 	// Create a frame buffer
 	frame_buffer = 0;
 	glGenFramebuffers(1, &frame_buffer);
@@ -49,48 +60,189 @@ bool RenderSystem::init(GLFWwindow* window_arg)
 	// code to use OpenGL 4.3 (not suported on mac) and add additional .h and .cpp
 	// glDebugMessageCallback((GLDEBUGPROC)errorCallback, nullptr);
 
-	// We are not really using VAO's but without at least one bound we will crash in
-	// some systems.
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	// Each geometry gets its own VAO, this one is bound in between so that stray
+	// buffer binds don't modify them.
+	glGenVertexArrays(1, &default_vao);
+	glBindVertexArray(default_vao);
 	gl_has_errors();
 
 	initScreenTexture();
 	initializeGlTextures();
 	initializeGlEffects();
 	initializeGlGeometryBuffers();
+	initializeSpriteBatch();
+	initializeLights();
+	initializeSamplers();
+	initializeParallaxLayers();
+	dynamic_resolution.init();
 
 	return true;
 }
 
+// Shown by the menu, streamed in before the other textures
+const TEXTURE_ASSET_ID MENU_TEXTURES[] = {
+	TEXTURE_ASSET_ID::LOADING_SCREEN,
+	TEXTURE_ASSET_ID::HP_BAR,
+	TEXTURE_ASSET_ID::HP,
+	TEXTURE_ASSET_ID::UBZ_TITLE,
+	TEXTURE_ASSET_ID::PLAY_BUTTON,
+	TEXTURE_ASSET_ID::BUS_LVL,
+	TEXTURE_ASSET_ID::BUSLOOP_LVL,
+	TEXTURE_ASSET_ID::STREET_LVL,
+	TEXTURE_ASSET_ID::IKB_LVL,
+	TEXTURE_ASSET_ID::MAINMALL_LVL,
+	TEXTURE_ASSET_ID::NEST_LVL,
+	TEXTURE_ASSET_ID::WRECK_LVL,
+	TEXTURE_ASSET_ID::FOREST_LVL,
+	TEXTURE_ASSET_ID::SEWER_LVL,
+	TEXTURE_ASSET_ID::LAB_LVL,
+};
+
 void RenderSystem::initializeGlTextures()
 {
-	glGenTextures((GLsizei)texture_gl_handles.size(), texture_gl_handles.data());
+	int worker_count = (int)std::thread::hardware_concurrency() - 1;
+	texture_streamer.init(std::max(1, std::min(worker_count, MAX_TEXTURE_STREAMING_WORKERS)), cooked_textures_path(""));
+
+#ifdef UBZ_TEXTURE_ATLAS
+	static_assert(TEXTURE_ATLAS_ENTRY_COUNT == texture_count, "The texture atlas is out of date, rebuild the texture_atlas target");
+	atlas_page_handles.resize(TEXTURE_ATLAS_PAGE_COUNT);
+	glGenTextures((GLsizei)atlas_page_handles.size(), atlas_page_handles.data());
+	for (uint i = 0; i < atlas_page_handles.size(); i++)
+		texture_streamer.request(textures_path(TEXTURE_ATLAS_PAGES[i]), atlas_page_handles[i], nullptr);
+#endif
+
+	std::array<bool, texture_count> is_menu_texture = {};
+	for (TEXTURE_ASSET_ID id : MENU_TEXTURES)
+		is_menu_texture[(int)id] = true;
 
 	for (uint i = 0; i < texture_paths.size(); i++)
 	{
-		const std::string& path = texture_paths[i];
-		ivec2& dimensions = texture_dimensions[i];
+		texture_uv_rects[i] = { 0.f, 0.f, 1.f, 1.f };
+#ifdef UBZ_TEXTURE_ATLAS
+		// Packed textures share their page's GL texture
+		const TextureAtlasEntry& entry = TEXTURE_ATLAS_ENTRIES[i];
+		if (entry.page >= 0)
+		{
+			texture_gl_handles[i] = atlas_page_handles[entry.page];
+			texture_dimensions[i] = { entry.width, entry.height };
+			texture_uv_rects[i] = { entry.u, entry.v, entry.uv_width, entry.uv_height };
+			texture_in_atlas[i] = true;
+			texture_requested[i] = true;
+			continue;
+		}
+#endif
+		glGenTextures(1, &texture_gl_handles[i]);
+		// The menu's textures are queued right away, the others by setLevelTextures and
+		// useLevelTextures
+		if (is_menu_texture[i])
+			requestTexture((TEXTURE_ASSET_ID)i);
+		else
+			TextureStreamer::setPlaceholder(texture_gl_handles[i]);
+	}
+	gl_has_errors();
+}
+
+void RenderSystem::requestTexture(TEXTURE_ASSET_ID id)
+{
+	int i = (int)id;
+	assert(!texture_requested[i]);
+	texture_requested[i] = true;
+	texture_streamer.request(texture_paths[i], texture_gl_handles[i], &texture_dimensions[i]);
+}
+
+void RenderSystem::setLevelTextures(const std::vector<TEXTURE_ASSET_ID>& textures)
+{
+	for (TEXTURE_ASSET_ID id : textures)
+		texture_level_scoped[(int)id] = true;
+
+#ifdef UBZ_TEXTURE_ATLAS
+	// Packed textures live in atlas pages shared with other levels' textures, they stay loaded
+	for (uint i = 0; i < texture_count; i++)
+	{
+		if (TEXTURE_ATLAS_ENTRIES[i].page >= 0)
+			texture_level_scoped[i] = false;
+	}
+#endif
+
+	for (uint i = 0; i < texture_count; i++)
+	{
+		if (!texture_level_scoped[i] && !texture_requested[i])
+			requestTexture((TEXTURE_ASSET_ID)i);
+	}
+}
+
+void RenderSystem::useLevelTextures(const std::vector<TEXTURE_ASSET_ID>& textures)
+{
+	// Take the new level's references first so textures both levels use are kept
+	std::vector<TEXTURE_ASSET_ID> previous_textures = std::move(current_level_textures);
+	current_level_textures.clear();
+	for (TEXTURE_ASSET_ID id : textures)
+	{
+		int i = (int)id;
+		if (!texture_level_scoped[i])
+			continue;
+		current_level_textures.push_back(id);
+		texture_refcounts[i]++;
+		if (!texture_requested[i])
+			requestTexture(id);
+	}
+
+	for (TEXTURE_ASSET_ID id : previous_textures)
+	{
+		int i = (int)id;
+		assert(texture_refcounts[i] > 0);
+		if (--texture_refcounts[i] == 0)
+			texture_release_order[i] = ++texture_release_count;
+	}
+
+	evictLevelTextures();
+}
 
-		stbi_uc* data;
-		data = stbi_load(path.c_str(), &dimensions.x, &dimensions.y, NULL, 4);
+size_t RenderSystem::getLevelTextureBytes() const
+{
+	size_t bytes = 0;
+	for (uint i = 0; i < texture_count; i++)
+	{
+		if (texture_level_scoped[i])
+			bytes += mipChainBytes(texture_dimensions[i].x, texture_dimensions[i].y, mipCount(texture_dimensions[i].x, texture_dimensions[i].y));
+	}
+	return bytes;
+}
 
-		if (data == NULL)
+void RenderSystem::evictLevelTextures()
+{
+	size_t bytes = getLevelTextureBytes();
+	while (bytes > texture_budget_bytes)
+	{
+		// Only textures that finished uploading can be unloaded, the streamer still writes
+		// into the others
+		int oldest = -1;
+		for (uint i = 0; i < texture_count; i++)
 		{
-			const std::string message = "Could not load the file " + path + ".";
-			fprintf(stderr, "%s", message.c_str());
-			assert(false);
+			if (!texture_level_scoped[i] || texture_refcounts[i] > 0 || texture_dimensions[i].x == 0)
+				continue;
+			if (oldest < 0 || texture_release_order[i] < texture_release_order[oldest])
+				oldest = (int)i;
 		}
+		if (oldest < 0)
+			break;
 
-		glBindTexture(GL_TEXTURE_2D, texture_gl_handles[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dimensions.x, dimensions.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		gl_has_errors();
-		stbi_image_free(data);
+		bytes -= mipChainBytes(texture_dimensions[oldest].x, texture_dimensions[oldest].y, mipCount(texture_dimensions[oldest].x, texture_dimensions[oldest].y));
+		TextureStreamer::setPlaceholder(texture_gl_handles[oldest], texture_dimensions[oldest]);
+		texture_dimensions[oldest] = { 0, 0 };
+		texture_requested[oldest] = false;
 	}
-	gl_has_errors();
+}
+
+float RenderSystem::getTextureLoadProgress() const
+{
+	int requested = texture_streamer.getRequestedCount();
+	return requested == 0 ? 1.f : (float)texture_streamer.getUploadedCount() / (float)requested;
+}
+
+void RenderSystem::finishTextureLoading()
+{
+	texture_streamer.finish();
 }
 
 void RenderSystem::initializeGlEffects()
@@ -102,10 +254,18 @@ void RenderSystem::initializeGlEffects()
 
 		bool is_valid = loadEffectFromFile(vertex_shader_name, fragment_shader_name, effects[i]);
 		assert(is_valid && (GLuint)effects[i] != 0);
+
+		// Resolve all uniform locations once instead of on every draw, attribute
+		// locations are fixed in the shaders
+		EffectLocations& locations = effect_locations[i];
+		for (uint u = 0; u < uniform_names.size(); u++)
+		{
+			locations.uniforms[u] = gl_state_query(glGetUniformLocation(effects[i], uniform_names[u].c_str()));
+		}
+		gl_has_errors();
 	}
 }
 
-// One could merge the following two functions as a template function...
 template <class T>
 void RenderSystem::bindVBOandIBO(GEOMETRY_BUFFER_ID gid, std::vector<T> vertices, std::vector<uint16_t> indices)
 {
@@ -118,6 +278,41 @@ void RenderSystem::bindVBOandIBO(GEOMETRY_BUFFER_ID gid, std::vector<T> vertices
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 		sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
 	gl_has_errors();
+
+	// Record the sizes, buffers and vertex format once so drawing never queries GL
+	// and only binds the vertex array
+	GeometryInfo& info = geometry_infos[(uint)gid];
+	info.vertex_count = (GLsizei)vertices.size();
+	info.index_count = (GLsizei)indices.size();
+	info.index_type = GL_UNSIGNED_SHORT; // indices are uint16_t
+	glBindVertexArray(vertex_arrays[(uint)gid]);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(uint)gid]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[(uint)gid]);
+	setVertexFormat(vertices.data());
+	glBindVertexArray(default_vao);
+	gl_has_errors();
+}
+
+void RenderSystem::setVertexFormat(const TexturedVertex*)
+{
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex), (void*)0);
+	glEnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+	glVertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex), (void*)sizeof(vec3)); // note the stride to skip the preceeding vertex position
+}
+
+void RenderSystem::setVertexFormat(const ColoredVertex*)
+{
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex), (void*)0);
+	glEnableVertexAttribArray(ATTRIBUTE_COLOR);
+	glVertexAttribPointer(ATTRIBUTE_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex), (void*)sizeof(vec3));
+}
+
+void RenderSystem::setVertexFormat(const vec3*)
+{
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
 }
 
 void RenderSystem::initializeGlMeshes()
@@ -144,6 +339,8 @@ void RenderSystem::initializeGlGeometryBuffers()
 	glGenBuffers((GLsizei)vertex_buffers.size(), vertex_buffers.data());
 	// Index Buffer creation.
 	glGenBuffers((GLsizei)index_buffers.size(), index_buffers.data());
+	// Vertex array creation, one per buffer pair
+	glGenVertexArrays((GLsizei)vertex_arrays.size(), vertex_arrays.data());
 
 	// Index and Vertex buffer data initialization.
 	initializeGlMeshes();
@@ -177,14 +374,200 @@ void RenderSystem::initializeGlGeometryBuffers()
 	bindVBOandIBO(GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE, screen_vertices, screen_indices);
 }
 
+void RenderSystem::initializeSpriteBatch()
+{
+	// The batch has its own VAO so the per instance attributes and their divisors don't leak
+	// into the other effects
+	glGenVertexArrays(1, &sprite_batch_vao);
+	glBindVertexArray(sprite_batch_vao);
+	glGenBuffers(1, &sprite_instance_buffer);
+	glGenBuffers(1, &baked_instance_buffer);
+	gl_has_errors();
+
+	// Per vertex data is the regular sprite quad
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(GLuint)GEOMETRY_BUFFER_ID::SPRITE]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[(GLuint)GEOMETRY_BUFFER_ID::SPRITE]);
+	setVertexFormat((const TexturedVertex*)nullptr);
+	gl_has_errors();
+
+	// Per instance data, advanced once per sprite
+	for (GLuint location = ATTRIBUTE_INSTANCE_TRANSFORM; location <= ATTRIBUTE_INSTANCE_FLAGS; location++)
+	{
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, sprite_instance_buffer);
+	setSpriteInstanceAttributes(0);
+	gl_has_errors();
+
+	glBindVertexArray(default_vao);
+	gl_has_errors();
+}
+
+void RenderSystem::initializeLights()
+{
+	memset(&light_block, 0, sizeof(light_block));
+	glGenBuffers(1, &lights_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, lights_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), &light_block, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BLOCK_BINDING, lights_buffer);
+	gl_has_errors();
+
+	// Stays bound to its own texture unit, sprites only use unit 0
+	glGenTextures(1, &attenuation_lut);
+	glActiveTexture(GL_TEXTURE0 + ATTENUATION_LUT_UNIT);
+	glBindTexture(GL_TEXTURE_2D, attenuation_lut);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, ATTENUATION_LUT_SIZE, MAX_LIGHTS, 0, GL_RED, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glActiveTexture(GL_TEXTURE0);
+	gl_has_errors();
+
+	// Light buffer and the framebuffer of the light pass, stays bound to its own unit too
+	glGenTextures(1, &light_buffer);
+	glActiveTexture(GL_TEXTURE0 + LIGHT_BUFFER_UNIT);
+	glBindTexture(GL_TEXTURE_2D, light_buffer);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, window_width_px / LIGHT_BUFFER_DOWNSCALE, window_height_px / LIGHT_BUFFER_DOWNSCALE, 0, GL_RG, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glActiveTexture(GL_TEXTURE0);
+	glGenFramebuffers(1, &light_frame_buffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, light_frame_buffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, light_buffer, 0);
+	assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gl_has_errors();
+
+	// GLSL 3.30 has no layout(binding = N), point the effects at the block and the units
+	for (uint i = 0; i < effect_count; i++)
+	{
+		GLuint block_index = gl_state_query(glGetUniformBlockIndex(effects[i], "LightBlock"));
+		if (block_index != GL_INVALID_INDEX)
+			glUniformBlockBinding(effects[i], block_index, LIGHTS_BLOCK_BINDING);
+
+		glUseProgram(effects[i]);
+		GLint lut_location = effect_locations[i].uniforms[(int)UNIFORM_ID::ATTENUATION_LUT];
+		if (lut_location >= 0)
+			glUniform1i(lut_location, ATTENUATION_LUT_UNIT);
+		GLint light_buffer_location = effect_locations[i].uniforms[(int)UNIFORM_ID::LIGHT_BUFFER];
+		if (light_buffer_location >= 0)
+			glUniform1i(light_buffer_location, LIGHT_BUFFER_UNIT);
+	}
+	glUseProgram(0);
+	gl_has_errors();
+}
+
+void RenderSystem::initializeSamplers()
+{
+	// Trilinear when zoomed out (full view mode, distant parallax layers), edges fade out
+	// instead of wrapping around
+	const float transparent[4] = { 0.f, 0.f, 0.f, 0.f };
+	glGenSamplers(1, &sprite_sampler);
+	glSamplerParameteri(sprite_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glSamplerParameteri(sprite_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(sprite_sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glSamplerParameteri(sprite_sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glSamplerParameterfv(sprite_sampler, GL_TEXTURE_BORDER_COLOR, transparent);
+	glBindSampler(SPRITE_TEXTURE_UNIT, sprite_sampler);
+	glBindSampler(PARALLAX_LAYERS_UNIT, sprite_sampler);
+	bound_sprite_sampler = sprite_sampler;
+
+#ifdef UBZ_TEXTURE_ATLAS
+	// Atlas pages are only padded for their first mip levels, the textures on them never
+	// reach a page's edge
+	glGenSamplers(1, &atlas_sampler);
+	glSamplerParameteri(atlas_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glSamplerParameteri(atlas_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameterf(atlas_sampler, GL_TEXTURE_MAX_LOD, (float)(TEXTURE_ATLAS_MIP_LEVELS - 1));
+	glSamplerParameteri(atlas_sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(atlas_sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#endif
+
+	glActiveTexture(GL_TEXTURE0 + SCREEN_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, off_screen_render_buffer_color);
+	glActiveTexture(GL_TEXTURE0 + SPRITE_TEXTURE_UNIT);
+	glUseProgram(effects[(GLuint)EFFECT_ASSET_ID::WATER]);
+	glUniform1i(effect_locations[(GLuint)EFFECT_ASSET_ID::WATER].uniforms[(int)UNIFORM_ID::SCREEN_TEXTURE], SCREEN_TEXTURE_UNIT);
+	glUseProgram(effects[(GLuint)EFFECT_ASSET_ID::PARALLAX]);
+	glUniform1i(effect_locations[(GLuint)EFFECT_ASSET_ID::PARALLAX].uniforms[(int)UNIFORM_ID::LAYERS], PARALLAX_LAYERS_UNIT);
+	glUseProgram(0);
+	gl_has_errors();
+}
+
+void RenderSystem::initializeParallaxLayers()
+{
+	// Sized by buildParallaxLayers once a level's backgrounds are known
+	glGenTextures(1, &parallax_layers);
+	glActiveTexture(GL_TEXTURE0 + PARALLAX_LAYERS_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, parallax_layers);
+	glActiveTexture(GL_TEXTURE0 + SPRITE_TEXTURE_UNIT);
+	glGenFramebuffers(2, parallax_copy_frame_buffers);
+	gl_has_errors();
+}
+
+void RenderSystem::buildParallaxLayers(const TEXTURE_ASSET_ID* textures, int count)
+{
+	ivec2 size = { 1, 1 };
+	for (int i = 0; i < count; i++)
+		size = max(size, texture_dimensions[(int)textures[i]]);
+
+	glActiveTexture(GL_TEXTURE0 + PARALLAX_LAYERS_UNIT);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size.x, size.y, count, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	// Each texture is scaled to the array's size by a blit, textures packed into an atlas
+	// page are copied from their rectangle of the page
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, parallax_copy_frame_buffers[0]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, parallax_copy_frame_buffers[1]);
+	for (int i = 0; i < count; i++)
+	{
+		const int id = (int)textures[i];
+		const ivec2 dimensions = texture_dimensions[id];
+		const vec4& uv_rect = texture_uv_rects[id];
+		const ivec2 page_size = { (int)roundf(dimensions.x / uv_rect.z), (int)roundf(dimensions.y / uv_rect.w) };
+		const ivec2 offset = { (int)roundf(uv_rect.x * page_size.x), (int)roundf(uv_rect.y * page_size.y) };
+
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_gl_handles[id], 0);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, parallax_layers, 0, i);
+		glBlitFramebuffer(offset.x, offset.y, offset.x + dimensions.x, offset.y + dimensions.y,
+			0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		parallax_layer_textures[i] = textures[i];
+	}
+	// Built in the middle of the frame, drawing goes on into the frame's target
+	glBindFramebuffer(GL_FRAMEBUFFER, frame_off_screen ? frame_buffer : 0);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glActiveTexture(GL_TEXTURE0 + SPRITE_TEXTURE_UNIT);
+	gl_has_errors();
+
+	parallax_layer_count = count;
+}
+
 RenderSystem::~RenderSystem()
 {
 	// Don't need to free gl resources since they last for as long as the program,
 	// but it's polite to clean after yourself.
 	glDeleteBuffers((GLsizei)vertex_buffers.size(), vertex_buffers.data());
 	glDeleteBuffers((GLsizei)index_buffers.size(), index_buffers.data());
+	glDeleteBuffers(1, &sprite_instance_buffer);
+	glDeleteBuffers(1, &baked_instance_buffer);
+	glDeleteBuffers(1, &lights_buffer);
+	glDeleteSamplers(1, &sprite_sampler);
+	glDeleteSamplers(1, &atlas_sampler);
+	glDeleteFramebuffers(2, parallax_copy_frame_buffers);
+	glDeleteTextures(1, &parallax_layers);
+	glDeleteVertexArrays((GLsizei)vertex_arrays.size(), vertex_arrays.data());
+	glDeleteVertexArrays(1, &sprite_batch_vao);
+	glDeleteVertexArrays(1, &default_vao);
+	// Atlas pages appear more than once, deleting a name again is ignored
 	glDeleteTextures((GLsizei)texture_gl_handles.size(), texture_gl_handles.data());
+	glDeleteTextures((GLsizei)atlas_page_handles.size(), atlas_page_handles.data());
 	glDeleteTextures(1, &off_screen_render_buffer_color);
+	glDeleteTextures(1, &attenuation_lut);
+	glDeleteTextures(1, &light_buffer);
+	glDeleteFramebuffers(1, &light_frame_buffer);
 	glDeleteRenderbuffers(1, &off_screen_render_buffer_depth);
 	gl_has_errors();
 
@@ -232,13 +615,13 @@ bool gl_compile_shader(GLuint shader)
 	glCompileShader(shader);
 	gl_has_errors();
 	GLint success = 0;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	gl_state_query(glGetShaderiv(shader, GL_COMPILE_STATUS, &success));
 	if (success == GL_FALSE)
 	{
 		GLint log_len;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
+		gl_state_query(glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len));
 		std::vector<char> log(log_len);
-		glGetShaderInfoLog(shader, log_len, &log_len, log.data());
+		gl_state_query(glGetShaderInfoLog(shader, log_len, &log_len, log.data()));
 		glDeleteShader(shader);
 
 		gl_has_errors();
@@ -303,13 +686,13 @@ bool loadEffectFromFile(
 
 	{
 		GLint is_linked = GL_FALSE;
-		glGetProgramiv(out_program, GL_LINK_STATUS, &is_linked);
+		gl_state_query(glGetProgramiv(out_program, GL_LINK_STATUS, &is_linked));
 		if (is_linked == GL_FALSE)
 		{
 			GLint log_len;
-			glGetProgramiv(out_program, GL_INFO_LOG_LENGTH, &log_len);
+			gl_state_query(glGetProgramiv(out_program, GL_INFO_LOG_LENGTH, &log_len));
 			std::vector<char> log(log_len);
-			glGetProgramInfoLog(out_program, log_len, &log_len, log.data());
+			gl_state_query(glGetProgramInfoLog(out_program, log_len, &log_len, log.data()));
 			gl_has_errors();
 
 			fprintf(stderr, "Link error: %s", log.data());
@@ -0,0 +1,130 @@
+// internal
+#include "spatial_grid.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <glm/common.hpp>    // min, max
+#include <glm/geometric.hpp> // dot
+
+SpatialGrid::SpatialGrid(float cell_size)
+{
+	setCellSize(cell_size);
+}
+
+void SpatialGrid::setCellSize(float size)
+{
+	assert(size > 0.f);
+	cell_size = size;
+}
+
+void SpatialGrid::add(Entity entity, vec2 position)
+{
+	pending_items.push_back({ entity, position });
+}
+
+void SpatialGrid::clear()
+{
+	pending_items.clear();
+	sorted_items.clear();
+	item_cells.clear();
+	cell_start.clear();
+	columns = 0;
+	rows = 0;
+}
+
+ivec2 SpatialGrid::cellCoord(vec2 position) const
+{
+	// Positions outside of the grid are clamped into the border cells
+	int x = (int)std::floor((position.x - origin.x) / cell_size);
+	int y = (int)std::floor((position.y - origin.y) / cell_size);
+	x = std::min(std::max(x, 0), columns - 1);
+	y = std::min(std::max(y, 0), rows - 1);
+	return { x, y };
+}
+
+int SpatialGrid::cellIndex(vec2 position) const
+{
+	ivec2 coord = cellCoord(position);
+	return coord.y * columns + coord.x;
+}
+
+void SpatialGrid::build()
+{
+	sorted_items.clear();
+	if (pending_items.empty())
+	{
+		clear();
+		return;
+	}
+
+	// Fit the grid to the bounding box of this frame's entities
+	vec2 lo = pending_items[0].position;
+	vec2 hi = lo;
+	for (const Item& item : pending_items)
+	{
+		lo = min(lo, item.position);
+		hi = max(hi, item.position);
+	}
+	origin = lo;
+	columns = std::min((int)((hi.x - lo.x) / cell_size) + 1, MAX_CELLS_PER_AXIS);
+	rows = std::min((int)((hi.y - lo.y) / cell_size) + 1, MAX_CELLS_PER_AXIS);
+
+	// Counting sort of the pending items by cell: count, prefix sum, scatter
+	cell_start.assign(columns * rows + 1, 0);
+	item_cells.resize(pending_items.size());
+	for (size_t i = 0; i < pending_items.size(); i++)
+	{
+		int cell = cellIndex(pending_items[i].position);
+		item_cells[i] = cell;
+		cell_start[cell + 1]++;
+	}
+	for (size_t c = 1; c < cell_start.size(); c++)
+		cell_start[c] += cell_start[c - 1];
+
+	// Copy rather than resize, default constructing an Entity would allocate a new id
+	sorted_items.assign(pending_items.begin(), pending_items.end());
+	std::vector<int> cursor(cell_start.begin(), cell_start.end() - 1);
+	for (size_t i = 0; i < pending_items.size(); i++)
+		sorted_items[cursor[item_cells[i]]++] = pending_items[i];
+
+	pending_items.clear();
+}
+
+int SpatialGrid::query(vec2 position, float radius, std::vector<Item>& out, int max_results) const
+{
+	if (sorted_items.empty() || max_results <= 0)
+		return 0;
+
+	const float radius_squared = radius * radius;
+	ivec2 center = cellCoord(position);
+	ivec2 lo = cellCoord(position - vec2(radius));
+	ivec2 hi = cellCoord(position + vec2(radius));
+
+	int count = 0;
+	auto visit = [&](int cx, int cy) {
+		int cell = cy * columns + cx;
+		for (const Item* it = cellBegin(cell); it != cellEnd(cell) && count < max_results; ++it)
+		{
+			vec2 d = it->position - position;
+			if (dot(d, d) <= radius_squared)
+			{
+				out.push_back(*it);
+				count++;
+			}
+		}
+	};
+
+	// Own cell first so that the closest neighbours survive the result cap
+	visit(center.x, center.y);
+	for (int cy = lo.y; cy <= hi.y && count < max_results; cy++)
+	{
+		for (int cx = lo.x; cx <= hi.x && count < max_results; cx++)
+		{
+			if (cx == center.x && cy == center.y)
+				continue;
+			visit(cx, cy);
+		}
+	}
+	return count;
+}
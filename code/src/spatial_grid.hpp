@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+
+// A uniform grid used for neighbour queries. The grid is rebuilt from scratch with
+// build() once per frame using a counting sort over the bounding box of the added
+// entities (levels scroll past the window so the extent isn't fixed), so inserting
+// n agents and querying each of them with a bounded neighbour count is O(n)
+// instead of the O(n^2) all-pairs loop.
+class SpatialGrid
+{
+public:
+	struct Item
+	{
+		Entity entity;
+		vec2 position;
+	};
+
+	SpatialGrid(float cell_size = 64.f);
+
+	// Change the cell size, takes effect on the next build()
+	void setCellSize(float cell_size);
+	float getCellSize() const { return cell_size; }
+
+	// Queue an entity for the next build()
+	void add(Entity entity, vec2 position);
+
+	// Bucket all added entities into their cells, call once after all add()s
+	void build();
+
+	// Remove all entities (keeps the allocated memory around for the next frame)
+	void clear();
+
+	// Appends up to max_results entities whose position lies within radius of position,
+	// starting with the cell position falls in. Returns the number of entities appended.
+	// Results are appended rather than written to a buffer since Entity() allocates a new id.
+	int query(vec2 position, float radius, std::vector<Item>& out, int max_results) const;
+
+	size_t size() const { return sorted_items.size(); }
+
+private:
+	// Upper bound on columns/rows so a stray far away entity can't blow up the grid
+	static const int MAX_CELLS_PER_AXIS = 256;
+
+	int cellIndex(vec2 position) const;
+	ivec2 cellCoord(vec2 position) const;
+
+	// Items of a single cell (valid until the next build())
+	const Item* cellBegin(int cell) const { return sorted_items.data() + cell_start[cell]; }
+	const Item* cellEnd(int cell) const { return sorted_items.data() + cell_start[cell + 1]; }
+
+	float cell_size;
+	vec2 origin = { 0.f, 0.f };
+	int columns = 0;
+	int rows = 0;
+
+	std::vector<Item> pending_items;
+	std::vector<Item> sorted_items;
+	std::vector<int> item_cells;
+	std::vector<int> cell_start; // prefix sums, size columns * rows + 1
+};
@@ -0,0 +1,220 @@
+// internal
+#include "texture_streamer.hpp"
+#include "cooked_texture.hpp"
+
+#include "../ext/stb_image/stb_image.h"
+
+// stlib
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	job_added.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+
+	for (Decoded& decoded : decoded_jobs)
+		release(decoded);
+	glDeleteBuffers(1, &pixel_buffer);
+}
+
+void TextureStreamer::init(int worker_count, const std::string& cooked_folder_arg)
+{
+	cooked_folder = cooked_folder_arg;
+	glGenBuffers(1, &pixel_buffer);
+	gl_has_errors();
+
+	for (int i = 0; i < worker_count; i++)
+		workers.emplace_back(&TextureStreamer::workerLoop, this);
+}
+
+void TextureStreamer::request(const std::string& path, GLuint texture, ivec2* dimensions)
+{
+	setPlaceholder(texture);
+
+	requested++;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back({ path, texture, dimensions });
+	}
+	job_added.notify_one();
+}
+
+int TextureStreamer::upload(size_t budget_bytes)
+{
+	int count = 0;
+	size_t bytes = 0;
+	while (bytes < budget_bytes)
+	{
+		Decoded decoded;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (decoded_jobs.empty())
+				break;
+			decoded = decoded_jobs.front();
+			decoded_jobs.pop_front();
+		}
+		bytes += decoded.bytes;
+		uploadDecoded(decoded);
+		count++;
+	}
+	return count;
+}
+
+void TextureStreamer::finish()
+{
+	while (!isDone())
+	{
+		Decoded decoded;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_decoded.wait(lock, [this] { return !decoded_jobs.empty(); });
+			decoded = decoded_jobs.front();
+			decoded_jobs.pop_front();
+		}
+		uploadDecoded(decoded);
+	}
+}
+
+void TextureStreamer::setPlaceholder(GLuint texture, ivec2 size)
+{
+	const unsigned char placeholder[4] = { 0, 0, 0, 0 };
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	// Free the smaller levels of an evicted texture too, uploads always fill the whole chain
+	const int mip_count = (int)mipCount(size.x, size.y);
+	for (int level = 1; level < mip_count; level++)
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	gl_has_errors();
+}
+
+void TextureStreamer::workerLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_added.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		Decoded decoded = { job, { 0, 0 }, 1, nullptr, 0, nullptr, nullptr };
+		std::ifstream file(job.path, std::ios::binary);
+		std::vector<unsigned char> source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (!source.empty())
+		{
+			loadCooked(source, decoded);
+			if (!decoded.cooked_file)
+			{
+				decoded.decoded_pixels = stbi_load_from_memory(source.data(), (int)source.size(), &decoded.size.x, &decoded.size.y, NULL, 4);
+				if (decoded.decoded_pixels)
+				{
+					premultiplyAlpha(decoded.decoded_pixels, (size_t)decoded.size.x * decoded.size.y);
+					decoded.pixels = decoded.decoded_pixels;
+					decoded.bytes = (size_t)decoded.size.x * decoded.size.y * 4;
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded_jobs.push_back(decoded);
+		}
+		job_decoded.notify_one();
+	}
+}
+
+void TextureStreamer::loadCooked(const std::vector<unsigned char>& source, Decoded& decoded) const
+{
+	if (cooked_folder.empty())
+		return;
+	MappedFile* file = new MappedFile();
+	const std::string path = cooked_folder + cookedTextureName(fnv1aHash(source.data(), source.size()));
+	if (file->open(path) && file->getSize() >= sizeof(CookedTextureHeader))
+	{
+		CookedTextureHeader header;
+		memcpy(&header, file->getData(), sizeof(header));
+		size_t bytes = mipChainBytes(header.width, header.height, header.mip_count);
+		if (header.magic == COOKED_TEXTURE_MAGIC && header.version == COOKED_TEXTURE_VERSION &&
+			header.mip_count > 0 && file->getSize() == sizeof(header) + bytes)
+		{
+			decoded.size = { (int)header.width, (int)header.height };
+			decoded.mip_count = (int)header.mip_count;
+			decoded.pixels = file->getData() + sizeof(header);
+			decoded.bytes = bytes;
+			decoded.cooked_file = file;
+			return;
+		}
+		fprintf(stderr, "Ignoring the invalid cooked texture %s\n", path.c_str());
+	}
+	delete file;
+}
+
+void TextureStreamer::uploadDecoded(Decoded& decoded)
+{
+	uploaded++;
+	if (decoded.pixels == NULL)
+	{
+		const std::string message = "Could not load the file " + decoded.job.path + ".";
+		fprintf(stderr, "%s", message.c_str());
+		assert(false);
+		return;
+	}
+	const bool is_cooked = decoded.cooked_file != nullptr;
+	if (is_cooked)
+		cooked++;
+
+	// Orphan the last upload's storage instead of waiting for GL to be done reading it,
+	// glTexImage2D then copies out of the buffer without stalling the main thread
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, decoded.bytes, nullptr, GL_STREAM_DRAW);
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, decoded.bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	assert(mapped);
+	memcpy(mapped, decoded.pixels, decoded.bytes);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	release(decoded);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, decoded.job.texture);
+	size_t offset = 0;
+	for (int level = 0; level < decoded.mip_count; level++)
+	{
+		int width = (int)mipSize(decoded.size.x, level);
+		int height = (int)mipSize(decoded.size.y, level);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)offset);
+		offset += (size_t)width * height * 4;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// Textures that weren't cooked get their mip chain from the driver
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)mipCount(decoded.size.x, decoded.size.y) - 1);
+	if (!is_cooked)
+		glGenerateMipmap(GL_TEXTURE_2D);
+	gl_has_errors();
+
+	if (decoded.job.dimensions)
+		*decoded.job.dimensions = decoded.size;
+}
+
+void TextureStreamer::release(Decoded& decoded)
+{
+	if (decoded.decoded_pixels)
+		stbi_image_free(decoded.decoded_pixels);
+	delete decoded.cooked_file;
+	decoded.decoded_pixels = nullptr;
+	decoded.cooked_file = nullptr;
+	decoded.pixels = nullptr;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// stlib
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "mapped_file.hpp"
+
+// Decodes texture files on worker threads and uploads them on the GL thread through a
+// pixel buffer object, a budget's worth per frame. Until its file is uploaded a texture
+// holds a transparent 1x1 placeholder, the GL names handed in never change.
+//
+// Textures come out with premultiplied alpha and a full mip chain. A worker first looks for
+// the file's cooked version (see cooked_texture.hpp) and maps it, mips included, and only
+// decodes the file itself if there is none, its mips are then generated by GL. Filtering and
+// wrapping come from RenderSystem's sampler objects.
+class TextureStreamer
+{
+public:
+	// Joins the workers, frees what was decoded but not uploaded and deletes the pixel buffer
+	~TextureStreamer();
+
+	// Starts the worker threads, call with the GL context current. Cooked textures are
+	// looked up in cooked_folder.
+	void init(int worker_count, const std::string& cooked_folder);
+
+	// Gives the texture its placeholder and queues the file to be decoded into it. Files are
+	// decoded in the order they were requested in. dimensions is set on upload if not null.
+	void request(const std::string& path, GLuint texture, ivec2* dimensions);
+
+	// Uploads decoded textures until budget_bytes of pixels went up (always at least one if
+	// any is ready), returns how many were uploaded
+	int upload(size_t budget_bytes);
+
+	// Blocks until every requested texture has been uploaded
+	void finish();
+
+	// Replaces the texture's image with the transparent 1x1 placeholder, size is what was
+	// uploaded into it so its mip levels can be freed as well
+	static void setPlaceholder(GLuint texture, ivec2 size = { 0, 0 });
+
+	int getRequestedCount() const { return requested; }
+	int getUploadedCount() const { return uploaded; }
+	// Uploads that came from the cooked cache rather than from decoding the file
+	int getCookedCount() const { return cooked; }
+	bool isDone() const { return uploaded == requested; }
+
+private:
+	struct Job
+	{
+		std::string path;
+		GLuint texture;
+		ivec2* dimensions;
+	};
+
+	struct Decoded
+	{
+		Job job;
+		ivec2 size;
+		int mip_count;
+		const unsigned char* pixels; // every mip level, null if the file could not be loaded
+		size_t bytes;
+		unsigned char* decoded_pixels; // stb_image allocation, if decoded from the file
+		MappedFile* cooked_file; // if read from the cooked cache
+	};
+
+	void workerLoop();
+	void loadCooked(const std::vector<unsigned char>& source, Decoded& decoded) const;
+	void uploadDecoded(Decoded& decoded);
+	static void release(Decoded& decoded);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable job_added;
+	std::condition_variable job_decoded;
+	std::deque<Job> jobs;
+	std::deque<Decoded> decoded_jobs;
+	bool stopping = false;
+	std::string cooked_folder;
+
+	GLuint pixel_buffer = 0;
+	int requested = 0;
+	int uploaded = 0;
+	int cooked = 0;
+};
@@ -84,6 +84,12 @@ public:
 		return map_entity_componentID.count(entity) > 0;
 	}
 
+	// Index of the entity's component in components, -1 if it has none
+	int index(Entity entity) {
+		auto it = map_entity_componentID.find(entity);
+		return it == map_entity_componentID.end() ? -1 : (int)it->second;
+	}
+
 	// Remove an component and pack the container to re-use the empty space
 	void remove(Entity e)
 	{
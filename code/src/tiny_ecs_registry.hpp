@@ -26,6 +26,7 @@ public:
 	ComponentContainer<ScreenState> screenStates;
 	ComponentContainer<Human> humans;
 	ComponentContainer<Zombie> zombies;
+	ComponentContainer<AILod> aiLods;
 	ComponentContainer<DebugComponent> debugComponents;
 	ComponentContainer<vec3> colors;
 	ComponentContainer<Platform> platforms;
@@ -68,6 +69,7 @@ public:
 		registry_list.push_back(&screenStates);
 		registry_list.push_back(&humans);
 		registry_list.push_back(&zombies);
+		registry_list.push_back(&aiLods);
 		registry_list.push_back(&debugComponents);
 		registry_list.push_back(&colors);
 		registry_list.push_back(&platforms);
@@ -1,6 +1,8 @@
 #include "world_init.hpp"
 #include "tiny_ecs_registry.hpp"
 
+#include <algorithm>
+
 using Clock = std::chrono::high_resolution_clock;
 
 Entity createBozo(RenderSystem* renderer, vec2 pos)
@@ -30,7 +32,8 @@ Entity createBozo(RenderSystem* renderer, vec2 pos)
 		entity,
 		{ TEXTURE_ASSET_ID::BOZO,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE_SHEET });
+			GEOMETRY_BUFFER_ID::SPRITE_SHEET,
+			RENDER_LAYER::PLAYER });
 
 	return entity;
 }
@@ -61,7 +64,8 @@ Entity createBozoPointer(RenderSystem* renderer, vec2 pos)
 		entity,
 		{ TEXTURE_ASSET_ID::BOZO_POINTER,
 			EFFECT_ASSET_ID::OVERLAY_TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::PLAYER, 1 });
 
 	return entity;
 }
@@ -96,7 +100,8 @@ Entity createStudent(RenderSystem* renderer, vec2 position, TEXTURE_ASSET_ID tex
 		entity,
 		{ textureId,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE_SHEET });
+			GEOMETRY_BUFFER_ID::SPRITE_SHEET,
+			RENDER_LAYER::CHARACTERS });
 
 	return entity;
 }
@@ -122,6 +127,8 @@ Entity createZombie(RenderSystem* renderer, vec2 position, TEXTURE_ASSET_ID text
 
 	// Create and (empty) Zombie component to be able to refer to all zombies
 	registry.zombies.emplace(entity);
+	AILod& lod = registry.aiLods.emplace(entity);
+	lod.phase = (unsigned int)entity;
 	registry.colors.insert(entity, { 1, 1, 1 });
 	std::vector<int> spriteCounts = { 4, 6, 6, 6 };
 	renderer->initializeSpriteSheet(entity, ANIMATION_MODE::RUN, spriteCounts, 100.f, vec2(0.0f, 0.01f));
@@ -130,7 +137,8 @@ Entity createZombie(RenderSystem* renderer, vec2 position, TEXTURE_ASSET_ID text
 		entity,
 		{ textureId,
 		 EFFECT_ASSET_ID::TEXTURED,
-		 GEOMETRY_BUFFER_ID::SPRITE_SHEET });
+		 GEOMETRY_BUFFER_ID::SPRITE_SHEET,
+		 RENDER_LAYER::CHARACTERS });
 
 	return entity;
 }
@@ -160,7 +168,8 @@ Entity createPlatform(RenderSystem* renderer, vec2 position, TEXTURE_ASSET_ID te
 			entity,
 			{ texture,
 			 EFFECT_ASSET_ID::TEXTURED,
-			 GEOMETRY_BUFFER_ID::SPRITE });
+			 GEOMETRY_BUFFER_ID::SPRITE,
+			 RENDER_LAYER::LEVEL });
 	}
 
 	return entity;
@@ -236,7 +245,8 @@ Entity createWall(RenderSystem* renderer, float position_x, float position_y, fl
 			entity,
 			{ texture,
 			 EFFECT_ASSET_ID::TEXTURED,
-			 GEOMETRY_BUFFER_ID::SPRITE });
+			 GEOMETRY_BUFFER_ID::SPRITE,
+			 RENDER_LAYER::LEVEL, 1 });
 	}
 	return entity;
 }
@@ -267,7 +277,8 @@ std::vector<Entity> createClimbable(RenderSystem* renderer, float top_position_x
 			entity,
 			{ texture,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::LEVEL, 3 });
 	}
 
 	return sections;
@@ -298,7 +309,8 @@ Entity createBackground(RenderSystem* renderer, TEXTURE_ASSET_ID texture, float
 		entity,
 		{ texture,
 		 blended ? EFFECT_ASSET_ID::BLENDED : EFFECT_ASSET_ID::TEXTURED,
-		 GEOMETRY_BUFFER_ID::SPRITE });
+		 GEOMETRY_BUFFER_ID::SPRITE,
+		 RENDER_LAYER::BACKGROUND });
 
 	return entity;
 }
@@ -346,7 +358,8 @@ Entity createSpike(RenderSystem* renderer, vec2 pos)
 		entity,
 		{ TEXTURE_ASSET_ID::TEXTURE_COUNT, // TEXTURE_COUNT indicates that no txture is needed
 			EFFECT_ASSET_ID::SPIKE,
-			GEOMETRY_BUFFER_ID::SPIKE });
+			GEOMETRY_BUFFER_ID::SPIKE,
+			RENDER_LAYER::HAZARDS });
 
 	return entity;
 }
@@ -374,7 +387,8 @@ Entity createWheel(RenderSystem* renderer, vec2 pos)
 		entity,
 		{ TEXTURE_ASSET_ID::TEXTURE_COUNT, // TEXTURE_COUNT indicates that no txture is needed
 			EFFECT_ASSET_ID::WHEEL,
-			GEOMETRY_BUFFER_ID::WHEEL });
+			GEOMETRY_BUFFER_ID::WHEEL,
+			RENDER_LAYER::HAZARDS });
 
 	return entity;
 }
@@ -403,7 +417,8 @@ Entity createBook(RenderSystem* renderer, vec2 position, TEXTURE_ASSET_ID textur
 		entity,
 		{ textureId,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::PROJECTILES });
 
 	return entity;
 }
@@ -430,7 +445,8 @@ Entity createStaticTexture(RenderSystem* renderer, TEXTURE_ASSET_ID textureID, v
 		entity,
 		{ textureID,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::LEVEL });
 
 	return entity;
 }
@@ -463,7 +479,8 @@ Entity createCollectible(RenderSystem* renderer, float position_x, float positio
 		entity,
 		{ collectible,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			overlay ? RENDER_LAYER::OVERLAY : RENDER_LAYER::ITEMS });
 
 	return entity;
 }
@@ -488,7 +505,8 @@ Entity createHeart(RenderSystem* renderer, vec2 position, vec2 scale) {
 		entity,
 		{ TEXTURE_ASSET_ID::HEART,
 			EFFECT_ASSET_ID::OVERLAY_TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::OVERLAY, 1 });
 
 	return entity;
 }
@@ -522,7 +540,8 @@ Entity createDangerous(RenderSystem* renderer, vec2 position, vec2 scale, TEXTUR
 		entity,
 		{ assetID,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE_SHEET });
+			GEOMETRY_BUFFER_ID::SPRITE_SHEET,
+			RENDER_LAYER::PROJECTILES });
 
 	return entity;
 }
@@ -548,7 +567,8 @@ Entity createBus(RenderSystem* renderer, vec2 position, vec2 scale, vec2 velocit
 		entity,
 		{ TEXTURE_ASSET_ID::BUSLOOP_BUS,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::BACKGROUND_PROPS });
 
 	return entity;
 }
@@ -570,12 +590,13 @@ Entity createLoadingScreen(RenderSystem* renderer, vec2 position, vec2 scale) {
 		entity,
 		{ TEXTURE_ASSET_ID::LOADING_SCREEN,
 			EFFECT_ASSET_ID::OVERLAY_TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::OVERLAY, 2 });
 
 	return entity;
 
 }
-Entity createOverlay(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE_ASSET_ID assetID, bool is_fading) {
+Entity createOverlay(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE_ASSET_ID assetID, bool is_fading, RENDER_LAYER layer) {
 	// Reserve en entity
 	auto entity = Entity();
 
@@ -600,7 +621,8 @@ Entity createOverlay(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE_
 		entity,
 		{ assetID,
 			EFFECT_ASSET_ID::OVERLAY_TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			layer });
 	return entity;
 }
 
@@ -626,7 +648,8 @@ Entity createDoor(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE_ASS
 		entity,
 		{ assetID,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE_SHEET });
+			GEOMETRY_BUFFER_ID::SPRITE_SHEET,
+			RENDER_LAYER::LEVEL, 2 });
 	return entity;
 }
 
@@ -657,7 +680,8 @@ Entity createBoss(RenderSystem* renderer, vec2 position, vec2 scale, float healt
 		entity,
 		{ assetID,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE_SHEET });
+			GEOMETRY_BUFFER_ID::SPRITE_SHEET,
+			RENDER_LAYER::CHARACTERS });
 
 	return entity;
 }
@@ -679,7 +703,8 @@ Entity createHPBar(RenderSystem* renderer, vec2 position) {
 		entity,
 		{ TEXTURE_ASSET_ID::HP_BAR,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::WORLD_UI, 1 });
 
 	return entity;
 }
@@ -701,7 +726,8 @@ Entity createHP(RenderSystem* renderer, vec2 position) {
 		entity,
 		{ TEXTURE_ASSET_ID::HP,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::WORLD_UI });
 
 	return entity;
 }
@@ -725,7 +751,8 @@ Entity createLight(RenderSystem* renderer, vec2 position, float intensity_dropof
 		entity,
 		{ TEXTURE_ASSET_ID::LIGHT,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE });
+			GEOMETRY_BUFFER_ID::SPRITE,
+			RENDER_LAYER::BACKGROUND_PROPS });
 
 	return entity;
 }
@@ -749,7 +776,8 @@ Entity createAnimatedBackgroundObject(RenderSystem* renderer, vec2 position, vec
 		entity,
 		{ assetID,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE_SHEET });
+			GEOMETRY_BUFFER_ID::SPRITE_SHEET,
+			RENDER_LAYER::BACKGROUND_PROPS });
 	return entity;
 }
 
@@ -775,18 +803,56 @@ Entity createCutscene(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE
 		entity,
 		{ assetID,
 			EFFECT_ASSET_ID::TEXTURED,
-			GEOMETRY_BUFFER_ID::SPRITE_SHEET });
+			GEOMETRY_BUFFER_ID::SPRITE_SHEET,
+			RENDER_LAYER::BACKGROUND_PROPS });
 	return entity;
 }
 
 // Wrapper method for removing entities
-// Removes all entity components and resets buffer id for sprite sheet components
+// Removes all entity components
 void removeEntity(Entity e) {
-	if (registry.spriteSheets.has(e))
-	{
-		SpriteSheet& spriteSheet = registry.spriteSheets.get(e);
-		RenderSystem::deleteBufferId(static_cast<int>(spriteSheet.bufferId));
+	registry.remove_all_components_of(e);
+}
+
+std::vector<TEXTURE_ASSET_ID> getLevelTextures(int level, bool has_boss, bool is_cutscene) {
+	size_t asset = (size_t)asset_mapping[level];
+	std::vector<TEXTURE_ASSET_ID> textures;
+	auto add = [&](const std::vector<TEXTURE_ASSET_ID>& table) {
+		if (asset < table.size())
+			textures.push_back(table[asset]);
+	};
+
+	if (asset < BACKGROUND_ASSET.size()) {
+		for (const auto& background : BACKGROUND_ASSET[asset])
+			textures.push_back(std::get<0>(background));
+	}
+	if (asset < COLLECTIBLE_ASSETS.size()) {
+		textures.insert(textures.end(), COLLECTIBLE_ASSETS[asset].begin(), COLLECTIBLE_ASSETS[asset].end());
 	}
+	add(PLATFORM_ASSET);
+	add(CLIMBABLE_ASSET);
+	add(DOOR_ASSET);
+	add(NPC_ASSET);
+	add(ZOMBIE_ASSET);
+	add(WEAPON_ASSETS);
+	add(LABEL_ASSETS);
+	if (has_boss)
+		add(BOSS_ASSET);
+	if (is_cutscene)
+		add(CUTSCENE_ASSET);
+
+	std::sort(textures.begin(), textures.end());
+	textures.erase(std::unique(textures.begin(), textures.end()), textures.end());
+	return textures;
+}
 
-	registry.remove_all_components_of(e);
-}
\ No newline at end of file
+std::vector<TEXTURE_ASSET_ID> getAllLevelTextures() {
+	std::vector<TEXTURE_ASSET_ID> textures;
+	for (int level = 0; level < (int)LEVEL_DESCRIPTORS.size(); level++) {
+		std::vector<TEXTURE_ASSET_ID> level_textures = getLevelTextures(level, true, true);
+		textures.insert(textures.end(), level_textures.begin(), level_textures.end());
+	}
+	std::sort(textures.begin(), textures.end());
+	textures.erase(std::unique(textures.begin(), textures.end()), textures.end());
+	return textures;
+}
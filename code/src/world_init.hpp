@@ -64,7 +64,7 @@ Entity createBus(RenderSystem* renderer, vec2 position, vec2 scale, vec2 velocit
 // dangerous object
 Entity createDangerous(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE_ASSET_ID assetID, vec2 p0, vec2 p1, vec2 p2, vec2 p3, bool cubic, bool bezier, int spriteCount);
 // label
-Entity createOverlay(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE_ASSET_ID textureId, bool is_fading);
+Entity createOverlay(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE_ASSET_ID textureId, bool is_fading, RENDER_LAYER layer = RENDER_LAYER::OVERLAY);
 // door
 Entity createDoor(RenderSystem* renderer, vec2 position, vec2 scale, TEXTURE_ASSET_ID textureId);
 // loading screen
@@ -437,4 +437,11 @@ const std::vector<TEXTURE_ASSET_ID> CUTSCENE_ASSET = {
   TEXTURE_ASSET_ID::CUT_3,
   TEXTURE_ASSET_ID::CUT_4,
   TEXTURE_ASSET_ID::CUT_1
-};
\ No newline at end of file
+};
+
+// ---------------------TEXTURE MANIFESTS-------------------------
+// Textures a level takes from the tables above, loaded when the level starts. The boss and
+// cutscene sheets only if the level JSON has a boss or is a cutscene.
+std::vector<TEXTURE_ASSET_ID> getLevelTextures(int level, bool has_boss, bool is_cutscene);
+// Every texture that is in some level's manifest, the others stay loaded the whole session
+std::vector<TEXTURE_ASSET_ID> getAllLevelTextures();
@@ -72,7 +72,7 @@ namespace
 
 // World initialization
 // Note, this has a lot of OpenGL specific things, could be moved to the renderer
-GLFWwindow* WorldSystem::create_window()
+GLFWwindow* WorldSystem::create_window(bool visible)
 {
 	///////////////////////////////////////
 	// Initialize GLFW
@@ -90,11 +90,16 @@ GLFWwindow* WorldSystem::create_window()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#ifdef NDEBUG
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_FALSE); // debug contexts can be slower
+#else
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE); // for the KHR_debug callback
+#endif
 #if __APPLE__
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
 	// Create the main window (for rendering, keyboard, and mouse input)
 	window = glfwCreateWindow(window_width_px, window_height_px, "UBZ", nullptr, nullptr);
@@ -165,6 +170,8 @@ GLFWwindow* WorldSystem::create_window()
 void WorldSystem::init(RenderSystem* renderer_arg)
 {
 	this->renderer = renderer_arg;
+	infection_system.init(renderer_arg);
+	renderer->setLevelTextures(getAllLevelTextures());
 
     // get level left off on
 	save_state = readJson(SAVE_STATE_FILE);
@@ -176,6 +183,38 @@ void WorldSystem::initGameState() {
 	restart_level();
 }
 
+void WorldSystem::setStressAgents(int count) {
+	stress_agents = count;
+}
+
+void WorldSystem::setRandomSeed(unsigned int seed)
+{
+	rng = std::default_random_engine(seed);
+	srand(seed);
+}
+
+void WorldSystem::spawnStressAgents(uint count) {
+	// Spread the agents around the level's spawn points
+	while (!zombie_spawn_pos.empty() && registry.zombies.size() < count) {
+		vec2 pos = zombie_spawn_pos[rng() % zombie_spawn_pos.size()];
+		pos.x += (uniform_dist(rng) - 0.5f) * 100.f;
+		createZombie(renderer, pos, ZOMBIE_ASSET[asset_mapping[curr_level]]);
+	}
+	uint num_students = 0;
+	while (!npc_spawn_pos.empty() && num_students < count) {
+		vec2 pos = npc_spawn_pos[rng() % npc_spawn_pos.size()];
+		pos.x += (uniform_dist(rng) - 0.5f) * 100.f;
+		Entity student = createStudent(renderer, pos, NPC_ASSET[asset_mapping[curr_level]]);
+		registry.motions.get(student).velocity.x = uniform_dist(rng) > 0.5f ? 100.f : -100.f;
+		num_students++;
+	}
+
+	// Keep respawning up to the stress counts
+	num_start_zombies = count;
+	num_start_students = count;
+	printf("Stress mode: %u zombies, %u students\n", (uint)registry.zombies.size(), num_students);
+}
+
 void WorldSystem::loadFromSave() {
     curr_level = save_state["current_level"].asInt();
 }
@@ -215,6 +254,10 @@ bool WorldSystem::step(float elapsed_ms_since_last_update)
 	Motion& bozo_motion = registry.motions.get(player_bozo);
 	std::vector<std::tuple<Motion*, Motion*>> charactersOnMovingPlat = {};
 
+	infection_system.step(elapsed_ms_since_last_update, ZOMBIE_ASSET[asset_mapping[curr_level]]);
+
+	raycaster.invalidateDynamic();
+
 	// If it is a boss level
 	if ((curr_level == MMBOSS || (curr_level == LAB && boss_active)) && registry.bosses.has(boss)) {
 
@@ -417,7 +460,6 @@ bool WorldSystem::handleTimers(Motion& motion, Entity motionEntity, float elapse
 	ScreenState& screen = registry.screenStates.components[0];
 
 	float min_timer_ms = 3000.f;
-	float infect_timer_ms = 3000.f;
 	float min_angle = asin(-1);
 	float max_angle = asin(1);
 
@@ -453,39 +495,6 @@ bool WorldSystem::handleTimers(Motion& motion, Entity motionEntity, float elapse
 			return true;
 		}
 	}
-	else if (registry.infectTimers.has(motionEntity))
-	{
-		// progress timer, make the rotation happening based on time
-		InfectTimer& timer = registry.infectTimers.get(motionEntity);
-		timer.timer_ms -= elapsed_ms_since_last_update;
-		if (timer.timer_ms < infect_timer_ms)
-		{
-			infect_timer_ms = timer.timer_ms;
-			if (timer.direction == 0)
-			{
-				if (motion.angle > min_angle)
-				{
-					motion.angle += asin(-1) / 50;
-				}
-			}
-			else
-			{
-				if (motion.angle < max_angle)
-				{
-					motion.angle += asin(1) / 50;
-				}
-			}
-		}
-
-		// remove the NPC player once the timer expires and create a zombie
-		if (timer.timer_ms < 0)
-		{
-			registry.infectTimers.remove(motionEntity);
-			Motion lastStudentLocation = registry.motions.get(motionEntity);
-			removeEntity(motionEntity);
-			Entity new_zombie = createZombie(renderer, lastStudentLocation.position, ZOMBIE_ASSET[asset_mapping[curr_level]]);
-		}
-	}
 	else if (registry.zombieDeathTimers.has(motionEntity)) {
 		ZombieDeathTimer& timer = registry.zombieDeathTimers.get(motionEntity);
 		timer.timer_ms -= elapsed_ms_since_last_update;
@@ -836,7 +845,10 @@ void WorldSystem::handleWorldCollisions(Motion& motion, Entity motionEntity, Mot
 		// If entity is a zombie, update its direction to always move towards Bozo
 		else if (isZombie && !registry.zombieDeathTimers.has(motionEntity))
 		{
-			updateZombieMovement(motion, bozo_motion, motionEntity, offAll);
+			if (!registry.aiLods.has(motionEntity) || registry.aiLods.get(motionEntity).tick)
+				updateZombieMovement(motion, bozo_motion, motionEntity, offAll);
+			else
+				updateZombieBetweenTicks(motion, motionEntity, offAll);
 		}
 		else if (isNPC)
 		{
@@ -1079,6 +1091,10 @@ void WorldSystem::updateZombieMovement(Motion& motion, Motion& bozo_motion, Enti
 	int bozo_level = checkLevel(bozo_motion);
 	int zombie_level = checkLevel(motion);
 
+	AILod no_lod;
+	AILod& lod = registry.aiLods.has(zombie) ? registry.aiLods.get(zombie) : no_lod;
+	lod.has_ladder = false;
+
 	if (curr_level == BUS) {
 		motion.velocity = { 0.f,0.f };
 		return;
@@ -1097,7 +1113,7 @@ void WorldSystem::updateZombieMovement(Motion& motion, Motion& bozo_motion, Enti
 	}
 	else if (curr_level == SEWERS) {
 		float dist = distance(motion.position, bozo_motion.position);
-		if (dist < 150.0 && bozo_motion.position.y - 15.f <= motion.position.y) {
+		if (dist < 150.0 && bozo_motion.position.y - 15.f <= motion.position.y && raycaster.lineOfSight(motion.position, bozo_motion.position)) {
 			if ((motion.position.x - bozo_motion.position.x) < -10) {
 				motion.velocity.x = ZOMBIE_SPEED / 1.f;
 			}
@@ -1113,13 +1129,7 @@ void WorldSystem::updateZombieMovement(Motion& motion, Motion& bozo_motion, Enti
 		}
 
 		if (offAll) {
-			if (motion.velocity.x > 0) {
-				motion.position.x -= 15.f;
-			}
-			else {
-				motion.position.x += 15.f;
-			}
-			motion.velocity.x = -motion.velocity.x;
+			turnAroundAtEdge(motion);
 		}
 	}
 	else if (curr_level == NEST && (zombie_level == bozo_level || (bozo_level <= 1 && zombie_level <= 1)))
@@ -1142,17 +1152,8 @@ void WorldSystem::updateZombieMovement(Motion& motion, Motion& bozo_motion, Enti
 			}
 
 			// When at the ladder, start descending
-			if ((target_ladder - 10.f < motion.position.x && motion.position.x < target_ladder + 10.f))
-			{
-				motion.position.x = target_ladder;
-				motion.velocity.x = 0;
-				motion.velocity.y = 2 * ZOMBIE_SPEED;
-				motion.climbing = true;
-			}
-			else
-			{
-				motion.climbing = false;
-			}
+			setLadder(lod, target_ladder, 10.f, 0.f, 2 * ZOMBIE_SPEED);
+			motion.climbing = startClimbing(motion, lod);
 		}
 		else if (curr_level == NEST && bozo_level == 0 && zombie_level == 0 && bozo_motion.position.x > 700 && motion.position.x < 700)
 		{
@@ -1170,17 +1171,8 @@ void WorldSystem::updateZombieMovement(Motion& motion, Motion& bozo_motion, Enti
 			}
 
 			// When at the ladder, start ascending
-			if ((target_ladder - 10.f < motion.position.x && motion.position.x < target_ladder + 10.f))
-			{
-				motion.position.x = target_ladder;
-				motion.velocity.x = 0;
-				motion.velocity.y = -2 * ZOMBIE_SPEED;
-				motion.climbing = true;
-			}
-			else
-			{
-				motion.climbing = false;
-			}
+			setLadder(lod, target_ladder, 10.f, 0.f, -2 * ZOMBIE_SPEED);
+			motion.climbing = startClimbing(motion, lod);
 		}
 		else
 		{
@@ -1234,17 +1226,8 @@ void WorldSystem::updateZombieMovement(Motion& motion, Motion& bozo_motion, Enti
 		}
 
 		// When at the ladder, start ascending
-		if ((target_ladder - 10.f < motion.position.x && motion.position.x < target_ladder + 10.f))
-		{
-			motion.position.x = target_ladder;
-			motion.velocity.x = 0;
-			motion.velocity.y = -1.2 * ZOMBIE_SPEED;
-			motion.climbing = true;
-		}
-		else
-		{
-			motion.climbing = false;
-		}
+		setLadder(lod, target_ladder, 10.f, 0.f, -1.2 * ZOMBIE_SPEED);
+		motion.climbing = startClimbing(motion, lod);
 	}
 	else
 	{
@@ -1264,21 +1247,12 @@ void WorldSystem::updateZombieMovement(Motion& motion, Motion& bozo_motion, Enti
 		}
 
 		// When at the ladder, start descending
-		if ((target_ladder - 15.f < motion.position.x && motion.position.x < target_ladder + 15.f))
-		{
-			motion.position.x = target_ladder;
-			motion.velocity.x = 0;
-			motion.position.y += 20;
-			motion.velocity.y = 2 * ZOMBIE_SPEED;
-			motion.climbing = true;
-		}
-		else
-		{
-			motion.climbing = false;
-		}
+		setLadder(lod, target_ladder, 15.f, 20.f, 2 * ZOMBIE_SPEED);
+		motion.climbing = startClimbing(motion, lod);
 
 	}
 
+	lod.level = zombie_level;
 	handleJumpPoints(motion, zombie_level);
 
 	// update zombie direction
@@ -1309,6 +1283,55 @@ void WorldSystem::updateZombieMovement(Motion& motion, Motion& bozo_motion, Enti
 	}
 }
 
+void WorldSystem::updateZombieBetweenTicks(Motion& motion, Entity zombie, bool offAll)
+{
+	// Keeps the velocity the decision logic last picked, only what can't wait for its next tick
+	const AILod& lod = registry.aiLods.get(zombie);
+	if (curr_level == BUS)
+		return;
+	if (!motion.climbing)
+		startClimbing(motion, lod);
+	if (curr_level == SEWERS && offAll)
+		turnAroundAtEdge(motion);
+	handleJumpPoints(motion, lod.level);
+
+	const Zombie& zombie_component = registry.zombies.get(zombie);
+	if (zombie_component.right_side_collision || zombie_component.left_side_collision)
+		motion.velocity.x = 0;
+}
+
+void WorldSystem::setLadder(AILod& lod, float ladder_x, float snap, float step_y, float velocity_y)
+{
+	lod.has_ladder = true;
+	lod.ladder_x = ladder_x;
+	lod.ladder_snap = snap;
+	lod.ladder_step_y = step_y;
+	lod.ladder_velocity_y = velocity_y;
+}
+
+bool WorldSystem::startClimbing(Motion& motion, const AILod& lod)
+{
+	if (!lod.has_ladder || abs(lod.ladder_x - motion.position.x) >= lod.ladder_snap)
+		return false;
+	motion.position.x = lod.ladder_x;
+	motion.velocity.x = 0;
+	motion.position.y += lod.ladder_step_y;
+	motion.velocity.y = lod.ladder_velocity_y;
+	motion.climbing = true;
+	return true;
+}
+
+void WorldSystem::turnAroundAtEdge(Motion& motion)
+{
+	if (motion.velocity.x > 0) {
+		motion.position.x -= 15.f;
+	}
+	else {
+		motion.position.x += 15.f;
+	}
+	motion.velocity.x = -motion.velocity.x;
+}
+
 void WorldSystem::handleJumpPoints(Motion& motion, int level) {
 	if (!motion.offGround) {
 		for (float pos : jump_positions[level]) {
@@ -1483,6 +1506,9 @@ void WorldSystem::restart_level()
 	while (registry.lights.entities.size() > 0)
 		registry.remove_all_components_of(registry.lights.entities.back());
 
+	infection_system.clear();
+	raycaster.clear();
+
 	// Debugging for memory/component leaks
 	registry.list_all_components();
 
@@ -1490,6 +1516,11 @@ void WorldSystem::restart_level()
 	std::ifstream file(LEVEL_DESCRIPTORS[curr_level]);
 	file >> jsonData;
 
+	// Swap in the level's textures, the level is never drawn with placeholders
+	bool has_boss = jsonData["boss"]["num_starting"].asInt() > 0;
+	renderer->useLevelTextures(getLevelTextures(curr_level, has_boss, jsonData["isCutscene"] == true));
+	renderer->finishTextureLoading();
+
 	// update BGM
 	background_music = Mix_LoadMUS(audio_path(jsonData["bgm"].asString()).c_str());
 	Mix_PlayMusic(background_music, -1);
@@ -1505,12 +1536,13 @@ void WorldSystem::restart_level()
 
 	// reset camera on restart
 	renderer->resetCamera(bozo_start_pos);
-	renderer->resetSpriteSheetTracker();
 
 
-	// Create background first (painter's algorithm for rendering)
-	for (std::tuple<TEXTURE_ASSET_ID, float> background : BACKGROUND_ASSET[asset_mapping[curr_level]]) {
-		createBackground(renderer, std::get<0>(background), std::get<1>(background));
+	// Create backgrounds, drawn in the order of the level's list
+	const auto& backgrounds = BACKGROUND_ASSET[asset_mapping[curr_level]];
+	for (uint i = 0; i < backgrounds.size(); i++) {
+		Entity background = createBackground(renderer, std::get<0>(backgrounds[i]), std::get<1>(backgrounds[i]));
+		registry.renderRequests.get(background).order = (uint16_t)i;
 	}
 
 	bus_array.clear();
@@ -1689,6 +1721,12 @@ void WorldSystem::restart_level()
 		student_spawn_on = false;
 	}
 
+	// Stress test mode replaces the level's zombie and student counts
+	int stress = stress_agents >= 0 ? stress_agents : jsonData["stress"].asInt();
+	if (stress > 0) {
+		spawnStressAgents(stress);
+	}
+
 	// Place collectibles
 	const Json::Value& collectiblesPositions = jsonData["collectibles"]["positions"];
 	num_collectibles = collectiblesPositions.size(); // set number of collectibles
@@ -1708,7 +1746,11 @@ void WorldSystem::restart_level()
 	if (curr_level == BEACH) {
 		createDangerous(renderer, { 280, 130 }, { 30, 30 }, TEXTURE_ASSET_ID::SPIKE_BALL, { 280, 130 }, { 500, 10 }, { 650, 250 }, { 0, 0 }, false, true, 6);
 		createDangerous(renderer, { 280, 130 }, { 50, 50 }, TEXTURE_ASSET_ID::BEACH_BIRD, { 0, 400 }, { 500, 50 }, { 1000, 750 }, { 1450, 400 }, true, true, 6);
-		createBackground(renderer, TEXTURE_ASSET_ID::CANNON, 0.f, { 230, 155 }, false, { 80, 60 });
+		// The cannon covers the spike ball it fires
+		Entity cannon = createBackground(renderer, TEXTURE_ASSET_ID::CANNON, 0.f, { 230, 155 }, false, { 80, 60 });
+		RenderRequest& cannon_request = registry.renderRequests.get(cannon);
+		cannon_request.layer = RENDER_LAYER::PROJECTILES;
+		cannon_request.order = 1;
 	}
 
 	mm_boss_rain.clear();
@@ -1720,6 +1762,9 @@ void WorldSystem::restart_level()
 	}
 	// Lives can probably stay hardcoded?
 
+	raycaster.buildStatic();
+	renderer->buildStaticLevel();
+
 	if (jsonData["isCutscene"] == true) {
 		playCutscene(renderer);
 	}
@@ -1937,18 +1982,8 @@ void WorldSystem::handle_collisions()
 					vec3& color = registry.colors.get(entity);
 					color = { 1.0f, 0.f, 0.f };
 
-					registry.infectTimers.emplace(entity);
-
-					// Set the direction of the death
-					InfectTimer& timer = registry.infectTimers.get(entity);
-					if (motion_zombie.velocity.x < 0)
-					{
-						timer.direction = 0;
-					}
-					else
-					{
-						timer.direction = 1;
-					}
+					// Fall over in the direction the zombie is walking
+					infection_system.infect(entity, motion_zombie.velocity.x >= 0);
 					Mix_PlayChannel(-1, player_death_sound, 0);
 				}
 			}
@@ -2149,7 +2184,7 @@ void WorldSystem::on_key(int key, int, int action, int mod)
     if (!pause && action == GLFW_PRESS && key == GLFW_KEY_ENTER && curr_level != CUT_1 && curr_level != CUT_2 && curr_level != CUT_3 && curr_level != CUT_4) {
       pause = true;
       if (pause) {
-        pause_ui = createOverlay(renderer, { window_width_px / 2, window_height_px / 2 - 100}, { 300.f, 500.f }, TEXTURE_ASSET_ID::PAUSE, false);
+        pause_ui = createOverlay(renderer, { window_width_px / 2, window_height_px / 2 - 100}, { 300.f, 500.f }, TEXTURE_ASSET_ID::PAUSE, false, RENDER_LAYER::OVERLAY_BACKGROUND);
         pause_resume = createOverlay(renderer, { window_width_px / 2, 400 - 100}, { 120, 60 }, TEXTURE_ASSET_ID::BACK_BUTTON, false);
         pause_restart_button = createOverlay(renderer, { window_width_px / 2, 490 - 100}, { 120, 60 }, TEXTURE_ASSET_ID::RETRY_BUTTON, false);
         pause_menu_button = createOverlay(renderer, { window_width_px / 2, 310 - 100}, { 120, 60 }, TEXTURE_ASSET_ID::MENU_BUTTON, false);
@@ -15,6 +15,8 @@
 #include<json/json.h>
 
 #include "render_system.hpp"
+#include "raycast.hpp"
+#include "infection_system.hpp"
 
 enum game_state {
 	MENU = 0,
@@ -48,8 +50,8 @@ public:
 
 	WorldSystem();
 
-	// Creates a window
-	GLFWwindow* create_window();
+	// Creates a window, an invisible one for headless rendering
+	GLFWwindow* create_window(bool visible = true);
 
 	// starts the game
 	void init(RenderSystem* renderer);
@@ -73,6 +75,12 @@ public:
 	void updateBossMotion(Motion& bozo_motion, float elapsed_ms_since_last_update);
 
 	void updateZombieMovement(Motion& motion, Motion& bozo_motion, Entity& zombie, bool offAll);
+	// Frames a zombie's AILod skips the decision logic on
+	void updateZombieBetweenTicks(Motion& motion, Entity zombie, bool offAll);
+	void setLadder(AILod& lod, float ladder_x, float snap, float step_y, float velocity_y);
+	// Gets on the ladder the zombie is heading for once close enough, returns whether it did
+	bool startClimbing(Motion& motion, const AILod& lod);
+	void turnAroundAtEdge(Motion& motion);
 
 	void updateClimbing(Motion& motion, vec4 entityBB, ComponentContainer<Motion>& motion_container);
 
@@ -91,10 +99,18 @@ public:
     void playHover();
 
     void loadFromSave();
+
+	// Stress test mode: spawn this many zombies and students per level instead of the level's
+	// own counts. -1 uses the level JSON's "stress" entry if there is one.
+	void setStressAgents(int count);
+
+	// Replaces the random device seed so runs can be repeated (headless captures)
+	void setRandomSeed(unsigned int seed);
 private:
 	void handleGameOver();
 	void updateWindowTitle();
 	void handleRespawn(float elapsed_ms_since_last_update);
+	void spawnStressAgents(uint count);
 	bool WorldSystem::handleTimers(Motion& motion, Entity motionEntity, float elapsed_ms_since_last_update);
 	void handleWeaponBehaviour(Motion& motion, Motion& bozo_motion, Entity entity);
 	void handleFadingEntities();
@@ -136,6 +152,10 @@ private:
 	RenderSystem* renderer;
 	Entity player_bozo;
 	Entity player_bozo_pointer;
+	// Ray and line of sight queries against the level geometry
+	RaycastSystem raycaster;
+	// Turns infected students into zombies
+	InfectionSystem infection_system;
 	Entity door;
 	Entity boss_blockade;
 	float enemySpawnTimer = 0.f;
@@ -208,5 +228,6 @@ private:
 
 	// Debugging
 	bool spawn_on = true;
+	int stress_agents = -1;
 
 };
@@ -0,0 +1,295 @@
+// Build time texture atlas packer
+//
+// Reads the texture list of RenderSystem::texture_paths (in TEXTURE_ASSET_ID order),
+// packs the textures of each level group (their sub folder in data/textures, the root
+// folder being the common group) into a few atlas pages and writes
+//  - the pages as uncompressed TGA files into data/textures/atlas/
+//  - a header mapping every TEXTURE_ASSET_ID to its page and UV rectangle
+// Textures too large to share a page (backgrounds, cutscenes) are left standalone.
+//
+// usage: atlas_packer <render_system.hpp> <textures folder> <output header>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Atlas pages are PAGE_SIZE wide and at most as high (cropped to what is used), 2048 is
+// supported by every GL 3.3 implementation
+const int PAGE_SIZE = 2048;
+// Textures with a side larger than this get their own GL texture
+const int MAX_PACKED_SIZE = 1024;
+// Mip levels the pages are sampled with. Packed textures start on a multiple of
+// MIP_ALIGNMENT and keep that many texels of border on every side, filled with their edge
+// texels, so down to the smallest sampled level a texel never mixes two textures and
+// linear filtering never reaches a neighbour.
+const int ATLAS_MIP_LEVELS = 4;
+const int MIP_ALIGNMENT = 1 << (ATLAS_MIP_LEVELS - 1);
+const int PADDING = MIP_ALIGNMENT;
+
+struct Image
+{
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels; // RGBA, top row first
+};
+
+struct Entry
+{
+	std::string path;
+	std::string group;
+	Image image;
+	int page = -1; // -1 if standalone
+	int x = 0;
+	int y = 0;
+};
+
+struct Page
+{
+	std::string name;
+	Image image;
+	int used_height = 0;
+};
+
+// Texture paths in the order of the TEXTURE_ASSET_ID enumerators
+static bool readTexturePaths(const std::string& header_path, std::vector<std::string>& paths)
+{
+	std::ifstream file(header_path);
+	if (!file.good())
+		return false;
+	std::stringstream ss;
+	ss << file.rdbuf();
+	const std::string source = ss.str();
+
+	size_t begin = source.find("texture_paths");
+	if (begin == std::string::npos)
+		return false;
+	size_t end = source.find("};", begin);
+	const std::string list = source.substr(begin, end - begin);
+
+	const std::regex path_regex("textures_path\\(\"([^\"]*)\"\\)");
+	for (auto it = std::sregex_iterator(list.begin(), list.end(), path_regex); it != std::sregex_iterator(); ++it)
+		paths.push_back((*it)[1]);
+	return !paths.empty();
+}
+
+static std::string groupOf(const std::string& path)
+{
+	size_t slash = path.find('/');
+	return slash == std::string::npos ? "common" : path.substr(0, slash);
+}
+
+static int alignUp(int size)
+{
+	return (size + MIP_ALIGNMENT - 1) / MIP_ALIGNMENT * MIP_ALIGNMENT;
+}
+
+// Copies the image into the page with its edge texels repeated into the padding
+static void blit(const Image& image, Image& page, int x, int y)
+{
+	for (int py = -PADDING; py < alignUp(image.height) + PADDING; py++)
+	{
+		int sy = std::min(std::max(py, 0), image.height - 1);
+		for (int px = -PADDING; px < alignUp(image.width) + PADDING; px++)
+		{
+			int sx = std::min(std::max(px, 0), image.width - 1);
+			const unsigned char* src = &image.pixels[(sy * image.width + sx) * 4];
+			unsigned char* dst = &page.pixels[((y + py) * page.width + (x + px)) * 4];
+			std::copy(src, src + 4, dst);
+		}
+	}
+}
+
+// Shelf packing: tallest textures first, filling rows left to right
+static void packGroup(std::vector<Entry*>& entries, const std::string& group, std::vector<Page>& pages)
+{
+	std::sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) {
+		return a->image.height > b->image.height;
+	});
+
+	int page_index = -1;
+	int group_pages = 0;
+	int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+	for (Entry* entry : entries)
+	{
+		int w = alignUp(entry->image.width) + 2 * PADDING;
+		int h = alignUp(entry->image.height) + 2 * PADDING;
+		if (page_index >= 0 && shelf_x + w > PAGE_SIZE)
+		{
+			shelf_x = 0;
+			shelf_y += shelf_height;
+			shelf_height = 0;
+		}
+		if (page_index < 0 || shelf_y + h > PAGE_SIZE)
+		{
+			Page page;
+			page.name = "atlas/" + group + "_" + std::to_string(group_pages++) + ".tga";
+			page.image.width = PAGE_SIZE;
+			page.image.height = PAGE_SIZE;
+			page.image.pixels.assign(PAGE_SIZE * PAGE_SIZE * 4, 0);
+			pages.push_back(page);
+			page_index = (int)pages.size() - 1;
+			shelf_x = 0;
+			shelf_y = 0;
+			shelf_height = 0;
+		}
+
+		entry->page = page_index;
+		entry->x = shelf_x + PADDING;
+		entry->y = shelf_y + PADDING;
+		blit(entry->image, pages[page_index].image, entry->x, entry->y);
+		shelf_x += w;
+		shelf_height = std::max(shelf_height, h);
+		pages[page_index].used_height = std::max(pages[page_index].used_height, shelf_y + shelf_height);
+	}
+}
+
+// Drops the unused rows at the bottom of a page, rows are stored top first
+static void cropPage(Page& page)
+{
+	page.image.height = alignUp(page.used_height);
+	page.image.pixels.resize(page.image.width * page.image.height * 4);
+}
+
+// Uncompressed 32 bit TGA with a top left origin, stb_image reads it back top row first
+static bool writeTGA(const std::string& path, const Image& image)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	unsigned char header[18] = {};
+	header[2] = 2; // uncompressed true colour
+	header[12] = image.width & 0xff;
+	header[13] = (image.width >> 8) & 0xff;
+	header[14] = image.height & 0xff;
+	header[15] = (image.height >> 8) & 0xff;
+	header[16] = 32;
+	header[17] = 0x28; // 8 alpha bits, top left origin
+	fwrite(header, 1, sizeof(header), file);
+
+	std::vector<unsigned char> bgra(image.pixels.size());
+	for (size_t i = 0; i < image.pixels.size(); i += 4)
+	{
+		bgra[i + 0] = image.pixels[i + 2];
+		bgra[i + 1] = image.pixels[i + 1];
+		bgra[i + 2] = image.pixels[i + 0];
+		bgra[i + 3] = image.pixels[i + 3];
+	}
+	fwrite(bgra.data(), 1, bgra.size(), file);
+	fclose(file);
+	return true;
+}
+
+static bool writeHeader(const std::string& path, const std::vector<Entry>& entries, const std::vector<Page>& pages)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+	fprintf(file, "#pragma once\n\n");
+	fprintf(file, "// Generated by tools/atlas_packer from RenderSystem::texture_paths, do not edit\n\n");
+	fprintf(file, "struct TextureAtlasEntry\n{\n");
+	fprintf(file, "\tint page; // index into TEXTURE_ATLAS_PAGES, -1 if the texture is standalone\n");
+	fprintf(file, "\tint width, height;\n");
+	fprintf(file, "\tfloat u, v, uv_width, uv_height; // rectangle of the texture on its page\n};\n\n");
+
+	fprintf(file, "// Mip levels the pages are padded for, sampling beyond them bleeds between textures\n");
+	fprintf(file, "#define TEXTURE_ATLAS_MIP_LEVELS %d\n", ATLAS_MIP_LEVELS);
+	fprintf(file, "#define TEXTURE_ATLAS_PAGE_COUNT %d\n", (int)pages.size());
+	fprintf(file, "static const char* TEXTURE_ATLAS_PAGES[TEXTURE_ATLAS_PAGE_COUNT] = {\n");
+	for (const Page& page : pages)
+		fprintf(file, "\t\"%s\",\n", page.name.c_str());
+	fprintf(file, "};\n\n");
+
+	fprintf(file, "#define TEXTURE_ATLAS_ENTRY_COUNT %d\n", (int)entries.size());
+	fprintf(file, "static const TextureAtlasEntry TEXTURE_ATLAS_ENTRIES[TEXTURE_ATLAS_ENTRY_COUNT] = {\n");
+	for (const Entry& entry : entries)
+	{
+		if (entry.page < 0)
+		{
+			fprintf(file, "\t{ -1, %d, %d, 0.f, 0.f, 1.f, 1.f }, // %s\n",
+				entry.image.width, entry.image.height, entry.path.c_str());
+			continue;
+		}
+		const Image& page = pages[entry.page].image;
+		fprintf(file, "\t{ %d, %d, %d, %.8ff, %.8ff, %.8ff, %.8ff }, // %s\n",
+			entry.page, entry.image.width, entry.image.height,
+			(float)entry.x / page.width, (float)entry.y / page.height,
+			(float)entry.image.width / page.width, (float)entry.image.height / page.height,
+			entry.path.c_str());
+	}
+	fprintf(file, "};\n");
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		fprintf(stderr, "usage: %s <render_system.hpp> <textures folder> <output header>\n", argv[0]);
+		return 1;
+	}
+	const std::string textures_folder = std::string(argv[2]) + "/";
+
+	std::vector<std::string> paths;
+	if (!readTexturePaths(argv[1], paths))
+	{
+		fprintf(stderr, "Could not read the texture paths from %s\n", argv[1]);
+		return 1;
+	}
+
+	std::vector<Entry> entries(paths.size());
+	std::map<std::string, std::vector<Entry*>> groups;
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		Entry& entry = entries[i];
+		entry.path = paths[i];
+		entry.group = groupOf(paths[i]);
+
+		const std::string file = textures_folder + paths[i];
+		stbi_uc* data = stbi_load(file.c_str(), &entry.image.width, &entry.image.height, NULL, 4);
+		if (data == NULL)
+		{
+			fprintf(stderr, "Could not load the file %s\n", file.c_str());
+			return 1;
+		}
+		if (entry.image.width <= MAX_PACKED_SIZE && entry.image.height <= MAX_PACKED_SIZE)
+		{
+			entry.image.pixels.assign(data, data + entry.image.width * entry.image.height * 4);
+			groups[entry.group].push_back(&entry);
+		}
+		stbi_image_free(data);
+	}
+
+	std::vector<Page> pages;
+	for (auto& group : groups)
+		packGroup(group.second, group.first, pages);
+
+	for (Page& page : pages)
+	{
+		cropPage(page);
+		if (!writeTGA(textures_folder + page.name, page.image))
+		{
+			fprintf(stderr, "Could not write %s\n", page.name.c_str());
+			return 1;
+		}
+	}
+	if (!writeHeader(argv[3], entries, pages))
+	{
+		fprintf(stderr, "Could not write %s\n", argv[3]);
+		return 1;
+	}
+
+	int packed = 0;
+	for (const Entry& entry : entries)
+		packed += entry.page >= 0;
+	printf("Packed %d of %d textures into %d atlas pages\n", packed, (int)entries.size(), (int)pages.size());
+	return 0;
+}
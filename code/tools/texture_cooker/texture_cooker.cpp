@@ -0,0 +1,146 @@
+// Build time texture cooker
+//
+// Converts every texture of the list file (one path per line) into a GPU ready file in the
+// cooked folder: premultiplied RGBA8 with its full mip chain, named after the hash of the
+// source file (format in src/cooked_texture.hpp). Textures that already have a cooked file
+// are skipped, the game decodes any texture without one itself.
+//
+// usage: texture_cooker <cooked folder> <texture list file>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "cooked_texture.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Box filters the level above into the next smaller one, sides of odd length repeat their last texel
+static void downsample(const std::vector<unsigned char>& src, int src_width, int src_height, std::vector<unsigned char>& dst, int dst_width, int dst_height)
+{
+	dst.resize((size_t)dst_width * dst_height * 4);
+	for (int y = 0; y < dst_height; y++)
+	{
+		int y0 = std::min(y * 2, src_height - 1);
+		int y1 = std::min(y * 2 + 1, src_height - 1);
+		for (int x = 0; x < dst_width; x++)
+		{
+			int x0 = std::min(x * 2, src_width - 1);
+			int x1 = std::min(x * 2 + 1, src_width - 1);
+			for (int c = 0; c < 4; c++)
+			{
+				int sum = src[((size_t)y0 * src_width + x0) * 4 + c] + src[((size_t)y0 * src_width + x1) * 4 + c] +
+					src[((size_t)y1 * src_width + x0) * 4 + c] + src[((size_t)y1 * src_width + x1) * 4 + c];
+				dst[((size_t)y * dst_width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+static bool readFile(const std::string& path, std::vector<unsigned char>& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.good())
+		return false;
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !data.empty();
+}
+
+static bool fileExists(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return file.good();
+}
+
+static bool cook(const std::vector<unsigned char>& source, const std::string& output_path)
+{
+	int width, height;
+	stbi_uc* data = stbi_load_from_memory(source.data(), (int)source.size(), &width, &height, NULL, 4);
+	if (data == NULL)
+		return false;
+
+	std::vector<unsigned char> level(data, data + (size_t)width * height * 4);
+	stbi_image_free(data);
+	premultiplyAlpha(level.data(), (size_t)width * height);
+
+	CookedTextureHeader header = {};
+	header.magic = COOKED_TEXTURE_MAGIC;
+	header.version = COOKED_TEXTURE_VERSION;
+	header.width = (uint32_t)width;
+	header.height = (uint32_t)height;
+	header.mip_count = mipCount(header.width, header.height);
+
+	// Written to a temporary file first so the game never maps a half written one
+	const std::string temp_path = output_path + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (!file)
+		return false;
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(level.data(), 1, level.size(), file);
+	std::vector<unsigned char> next;
+	for (uint32_t i = 1; i < header.mip_count; i++)
+	{
+		int src_width = (int)mipSize(header.width, i - 1);
+		int src_height = (int)mipSize(header.height, i - 1);
+		downsample(level, src_width, src_height, next, (int)mipSize(header.width, i), (int)mipSize(header.height, i));
+		fwrite(next.data(), 1, next.size(), file);
+		level.swap(next);
+	}
+	fclose(file);
+	std::remove(output_path.c_str());
+	return std::rename(temp_path.c_str(), output_path.c_str()) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <cooked folder> <texture list file>\n", argv[0]);
+		return 1;
+	}
+	const std::string cooked_folder = std::string(argv[1]) + "/";
+	std::ifstream list(argv[2]);
+	if (!list.good())
+	{
+		fprintf(stderr, "Could not read the texture list %s\n", argv[2]);
+		return 1;
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	int cooked = 0;
+	int up_to_date = 0;
+	std::string path;
+	while (std::getline(list, path))
+	{
+		if (!path.empty() && path.back() == '\r')
+			path.pop_back();
+		if (path.empty())
+			continue;
+		std::vector<unsigned char> source;
+		if (!readFile(path, source))
+		{
+			fprintf(stderr, "Could not read the file %s\n", path.c_str());
+			return 1;
+		}
+		const std::string output_path = cooked_folder + cookedTextureName(fnv1aHash(source.data(), source.size()));
+		if (fileExists(output_path))
+		{
+			up_to_date++;
+			continue;
+		}
+		if (!cook(source, output_path))
+		{
+			fprintf(stderr, "Could not cook %s into %s\n", path.c_str(), output_path.c_str());
+			return 1;
+		}
+		cooked++;
+	}
+
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	printf("Cooked %d textures (%d up to date) in %lld ms\n", cooked, up_to_date, (long long)ms);
+	return 0;
+}